@@ -17,8 +17,10 @@
 #include <crypto/null.h>
 #include <crypto/scatterwalk.h>
 #include <crypto/sha.h>
+#include <asm/unaligned.h>
 
 #include <linux/dma-mapping.h>
+#include <linux/dmapool.h>
 #include <linux/scatterlist.h>
 #include <linux/types.h>
 
@@ -28,44 +30,52 @@
 #include "eip93-regs.h"
 #include "eip93-ring.h"
 
-inline void mtk_free_sg_cpy(const int len, struct scatterlist **sg)
+inline void mtk_free_sg_cpy(struct mtk_device *mtk, struct scatterlist **sg,
+				struct mtk_bounce *b)
 {
-	if (!*sg || !len)
+	if (!*sg)
 		return;
 
-	free_pages((unsigned long)sg_virt(*sg), get_order(len));
-	kfree(*sg);
+	mtk_bounce_put(mtk, b);
 	*sg = NULL;
 }
 
-inline int mtk_make_sg_cpy(struct scatterlist *src, struct scatterlist **dst,
-		const int len, struct mtk_cipher_reqctx *rctx, const bool copy)
+/*
+ * Point *dst at a single entry bounce buffer from the device pool, large
+ * enough for the whole request, and fill it with @len bytes of @src when
+ * @copy is set. The entry comes DMA mapped. Never sleeps; -EAGAIN means
+ * the pool is used up for now.
+ */
+inline int mtk_make_sg_cpy(struct mtk_device *mtk, struct scatterlist *src,
+		struct scatterlist **dst, struct mtk_bounce *b,
+		struct scatterlist *sg, const int len,
+		struct mtk_cipher_reqctx *rctx, const bool copy)
 {
-	void *pages;
 	int totallen;
+	int err;
 
-	*dst = kmalloc(sizeof(**dst), GFP_KERNEL);
-	if (!*dst) {
-		printk("NO MEM\n");
-		return -ENOMEM;
-	}
 	/* allocate enough memory for full scatterlist */
 	totallen = rctx->assoclen + rctx->textsize + rctx->authsize;
 
-	pages = (void *)__get_free_pages(GFP_KERNEL | GFP_DMA,
-					get_order(totallen));
-	if (!pages) {
-		kfree(*dst);
-		*dst = NULL;
-		printk("no free pages\n");
-		return -ENOMEM;
-	}
+	err = mtk_bounce_get(mtk, totallen, b);
+	if (err)
+		return err;
 
-	sg_init_table(*dst, 1);
-	sg_set_buf(*dst, pages, totallen);
 	/* copy only as requested */
 	if (copy)
-		sg_copy_to_buffer(src, sg_nents(src), pages, len);
+		sg_copy_to_buffer(src, sg_nents(src), b->buf, len);
+
+	err = mtk_bounce_to_device(mtk, b);
+	if (err) {
+		mtk_bounce_put(mtk, b);
+		return err;
+	}
+
+	sg_init_table(sg, 1);
+	sg_set_buf(sg, b->buf, totallen);
+	sg_dma_address(sg) = b->dma;
+	sg_dma_len(sg) = totallen;
+	*dst = sg;
 
 	return 0;
 }
@@ -98,6 +108,348 @@ inline bool mtk_is_sg_aligned(struct scatterlist *sg, u32 len, const int blksz)
 	return false;
 }
 
+/*
+ * AEAD requests run on the caller's buffers when the engine can carry the
+ * hash and the cipher from one descriptor to the next: every segment
+ * starts on a cache line, the first descriptor holds all of the AAD, every
+ * descriptor but the last is a whole number of hash blocks and ends its
+ * cipher part on a @blksz block, and the tag sits right behind the data.
+ * Checks every segment boundary; mtk_scatter_combine() cuts at a subset
+ * of them once contiguous entries are merged. Returns the number of
+ * segments, 0 when the request has to be bounced.
+ */
+static int mtk_aead_direct(struct scatterlist *src, struct scatterlist *dst,
+				u32 datalen, u32 aad, u32 authsize, u32 blksz)
+{
+	u32 remainin, remainout, len, n = datalen;
+	int ndesc = 0;
+
+	if (!IS_ALIGNED(aad, sizeof(u32)) || aad / sizeof(u32) > 255)
+		return 0;
+
+	if (!IS_ALIGNED(src->offset, 32) || !IS_ALIGNED(dst->offset, 32))
+		return 0;
+
+	remainin = src->length;
+	remainout = dst->length;
+
+	while (n) {
+		len = min3(remainin, remainout, n);
+		if (!len)
+			return 0;
+
+		if (!ndesc && len < aad)
+			return 0;
+
+		if (len < n && !IS_ALIGNED(len, SHA256_BLOCK_SIZE))
+			return 0;
+
+		/* the first descriptor only ciphers what follows the AAD */
+		if (len < n && !IS_ALIGNED(ndesc ? len : len - aad, blksz))
+			return 0;
+
+		n -= len;
+		remainin -= len;
+		remainout -= len;
+		ndesc++;
+
+		if (!n)
+			break;
+
+		if (!remainin) {
+			src = sg_next(src);
+			if (!src || !IS_ALIGNED(src->offset, 32))
+				return 0;
+			remainin = src->length;
+		}
+
+		if (!remainout) {
+			dst = sg_next(dst);
+			if (!dst || !IS_ALIGNED(dst->offset, 32))
+				return 0;
+			remainout = dst->length;
+		}
+	}
+
+	/* tag read from or written behind the data, in the same segment */
+	if (remainin < authsize || remainout < authsize)
+		return 0;
+
+	return ndesc;
+}
+
+#ifdef CONFIG_CRYPTO_MANAGER_EXTRA_TESTS
+/*
+ * ESP with extended sequence numbers has 24 bytes of AAD: over two
+ * segments the first descriptor would cipher 104 bytes, a whole number
+ * of DES blocks but not of AES blocks.
+ */
+int mtk_aead_selftest(void)
+{
+	static const struct {
+		u32 aad;
+		u32 blksz;
+		int ndesc;
+	} tests[] = {
+		{ 24, AES_BLOCK_SIZE, 0 },
+		{ 24, DES_BLOCK_SIZE, 2 },
+		{ 32, AES_BLOCK_SIZE, 2 },
+	};
+	struct scatterlist sg[2];
+	u8 *buf;
+	int i, ret = 0;
+
+	buf = kmalloc(2 * SHA256_BLOCK_SIZE * 2, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	sg_init_table(sg, 2);
+	sg_set_buf(&sg[0], buf, 2 * SHA256_BLOCK_SIZE);
+	sg_set_buf(&sg[1], buf + 2 * SHA256_BLOCK_SIZE,
+			SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE);
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		if (mtk_aead_direct(sg, sg, 3 * SHA256_BLOCK_SIZE,
+				tests[i].aad, SHA256_DIGEST_SIZE,
+				tests[i].blksz) != tests[i].ndesc) {
+			pr_err("eip93: AEAD direct test %d failed\n", i);
+			ret = -EINVAL;
+		}
+	}
+
+	kfree(buf);
+
+	return ret;
+}
+#endif
+
+/*
+ * Store the tag the engine produced at @len in @dst. EIP93 Little endian
+ * MD5; Big Endian all SHA: the target data byte order serves payload and
+ * digest alike, so SHA words are put right here, on the way out.
+ */
+static void mtk_aead_put_tag(struct scatterlist *dst, u32 len,
+				const u32 *otag, u32 authsize,
+				unsigned long int flags)
+{
+	u32 tag[SHA256_DIGEST_SIZE / sizeof(u32)];
+	int i;
+
+	for (i = 0; i < (authsize / 4); i++)
+		tag[i] = IS_HASH_MD5(flags) ? otag[i] : ntohl(otag[i]);
+
+	scatterwalk_map_and_copy(tag, dst, len, authsize, 1);
+}
+
+static bool mtk_plan_add(struct mtk_plan *plan, u32 pos, u32 len,
+				struct scatterlist *src, u32 soff,
+				struct scatterlist *dst, u32 doff)
+{
+	struct mtk_plan_piece *piece;
+
+	if (plan->npieces == MTK_PLAN_PIECES)
+		return false;
+
+	piece = &plan->piece[plan->npieces++];
+	piece->pos = pos;
+	piece->len = len;
+	piece->src = src;
+	piece->soff = soff;
+	piece->dst = dst;
+	piece->doff = doff;
+	piece->boff = -1;
+
+	if (!src) {
+		piece->boff = plan->bounced;
+		/* every stitched piece starts on its own cache line */
+		plan->bounced += ALIGN(len, 32);
+	}
+
+	return true;
+}
+
+/*
+ * Cut a misaligned request at the union of its src and dst segment
+ * boundaries. A run of whole blocks inside one src and one dst segment,
+ * whose first cache line holds nothing but request bytes, goes to the
+ * engine as it is; whatever lies in between, e.g. a block straddling two
+ * segments or an odd header, is stitched together in a small bounce
+ * buffer. A direct run shorter than MTK_PLAN_DESC_COST does not pay for
+ * its descriptor and is copied as well. Returns false when bouncing the
+ * whole request is cheaper, or the plan needs too many descriptors.
+ */
+static bool mtk_plan(struct mtk_plan *plan, struct scatterlist *src,
+			struct scatterlist *dst, u32 total, u32 blksize)
+{
+	u32 a = 0, b, pos = 0, sa = 0, da = 0, d0, d1;
+	u32 send, dend, bounce = 0;
+
+	plan->npieces = 0;
+	plan->bounced = 0;
+
+	while (a < total) {
+		if (!src || !dst)
+			return false;
+
+		send = sa + src->length;
+		dend = da + dst->length;
+		b = min3(send, dend, total);
+
+		/* skip the bytes that share a cache line with foreign data */
+		d0 = max3(pos, sa + ((-src->offset) & 31),
+				da + ((-dst->offset) & 31));
+		d0 = round_up(max(d0, a), blksize);
+		d1 = (b == total) ? b : round_down(b, blksize);
+
+		/* the engine reads and writes whole words */
+		if (((src->offset + d0 - sa) | (dst->offset + d0 - da)) & 3)
+			d1 = d0;
+
+		if (d1 > d0 && d1 - d0 >= MTK_PLAN_DESC_COST) {
+			if (d0 > pos) {
+				if (!mtk_plan_add(plan, pos, d0 - pos,
+							NULL, 0, NULL, 0))
+					return false;
+				bounce += d0 - pos;
+			}
+
+			if (!mtk_plan_add(plan, d0, d1 - d0, src, d0 - sa,
+							dst, d0 - da))
+				return false;
+			pos = d1;
+		}
+
+		a = b;
+		if (b == send) {
+			src = sg_next(src);
+			sa = b;
+		}
+		if (b == dend) {
+			dst = sg_next(dst);
+			da = b;
+		}
+	}
+
+	if (pos < total) {
+		if (!mtk_plan_add(plan, pos, total - pos, NULL, 0, NULL, 0))
+			return false;
+		bounce += total - pos;
+	}
+
+	/* copy in and out against a single descriptor over a full copy */
+	if (plan->npieces * MTK_PLAN_DESC_COST + 2 * bounce >=
+				MTK_PLAN_DESC_COST + 2 * total) {
+		plan->npieces = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Turn the plan into scatterlists for the engine, once the caller's
+ * buffers are mapped, and fill the stitched pieces.
+ */
+static int mtk_plan_build(struct mtk_device *mtk,
+			struct mtk_cipher_reqctx *rctx, struct scatterlist *reqsrc,
+			struct scatterlist **src, struct scatterlist **dst)
+{
+	struct mtk_plan *plan = &rctx->plan;
+	struct mtk_bounce *b = &rctx->bounce[0];
+	struct mtk_plan_piece *piece;
+	struct scatterlist *sgs, *sgd;
+	bool inplace = (*src == *dst);
+	int i, err;
+
+	if (plan->bounced) {
+		err = mtk_bounce_get(mtk, plan->bounced, b);
+		if (err)
+			return err;
+
+		for (i = 0; i < plan->npieces; i++) {
+			piece = &plan->piece[i];
+			if (piece->boff >= 0)
+				sg_pcopy_to_buffer(reqsrc, sg_nents(reqsrc),
+					b->buf + piece->boff, piece->len,
+					piece->pos);
+		}
+
+		err = mtk_bounce_to_device(mtk, b);
+		if (err) {
+			mtk_bounce_put(mtk, b);
+			return err;
+		}
+		plan->held = true;
+	}
+
+	sg_init_table(rctx->plan_src, plan->npieces);
+	sg_init_table(rctx->plan_dst, plan->npieces);
+
+	for (i = 0; i < plan->npieces; i++) {
+		piece = &plan->piece[i];
+		sgs = &rctx->plan_src[i];
+		sgd = &rctx->plan_dst[i];
+
+		if (piece->boff >= 0) {
+			sg_set_buf(sgs, b->buf + piece->boff, piece->len);
+			sg_dma_address(sgs) = b->dma + piece->boff;
+			sg_set_buf(sgd, b->buf + piece->boff, piece->len);
+			sg_dma_address(sgd) = b->dma + piece->boff;
+		} else {
+			sg_set_page(sgs, sg_page(piece->src), piece->len,
+					piece->src->offset + piece->soff);
+			sg_dma_address(sgs) = sg_dma_address(piece->src) +
+					piece->soff;
+			sg_set_page(sgd, sg_page(piece->dst), piece->len,
+					piece->dst->offset + piece->doff);
+			sg_dma_address(sgd) = sg_dma_address(piece->dst) +
+					piece->doff;
+		}
+		sg_dma_len(sgs) = piece->len;
+		sg_dma_len(sgd) = piece->len;
+	}
+
+	*src = rctx->plan_src;
+	*dst = inplace ? rctx->plan_src : rctx->plan_dst;
+
+	return 0;
+}
+
+/* Copy the stitched pieces out, once the caller's dst is unmapped */
+static void mtk_plan_finish(struct mtk_device *mtk,
+			struct mtk_cipher_reqctx *rctx, struct scatterlist *reqdst)
+{
+	struct mtk_plan *plan = &rctx->plan;
+	struct mtk_bounce *b = &rctx->bounce[0];
+	struct mtk_plan_piece *piece;
+	int i;
+
+	if (!plan->held)
+		return;
+
+	mtk_bounce_to_cpu(mtk, b);
+
+	for (i = 0; i < plan->npieces; i++) {
+		piece = &plan->piece[i];
+		if (piece->boff >= 0)
+			sg_pcopy_from_buffer(reqdst, sg_nents(reqdst),
+				b->buf + piece->boff, piece->len, piece->pos);
+	}
+
+	mtk_bounce_put(mtk, b);
+	plan->held = false;
+}
+
+static void mtk_plan_release(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx)
+{
+	if (rctx->plan.held)
+		mtk_bounce_put(mtk, &rctx->bounce[0]);
+
+	rctx->plan.held = false;
+	rctx->plan.npieces = 0;
+}
+
 inline void mtk_ctx_saRecord(struct mtk_cipher_ctx *ctx, const u8 *key,
 				const u32 nonce, const unsigned int keylen,
 				const unsigned long int flags)
@@ -180,6 +532,7 @@ inline void mtk_ctx_saRecord(struct mtk_cipher_ctx *ctx, const u8 *key,
 	}
 
 	memcpy(saRecord->saKey, key, keylen);
+	ctx->dec_keylen = 0;
 
 	if (IS_RFC3686(flags))
 		saRecord->saNonce = nonce;
@@ -189,18 +542,177 @@ inline void mtk_ctx_saRecord(struct mtk_cipher_ctx *ctx, const u8 *key,
 	saRecord->saSpi = 0x0;
 	saRecord->saSeqNumMask[0] = 0xFFFFFFFF;
 	saRecord->saSeqNumMask[1] = 0x0;
+
+	if (ctx->aead)
+		saRecord->saCmd0.bits.opCode = 1;
+}
+
+/*
+ * Drop all prepared variants, so they are rebuilt from ctx->sa. Only
+ * called from setkey/setauthsize/exit, when no request may be in flight.
+ */
+static void mtk_sa_cache_flush(struct mtk_cipher_ctx *ctx)
+{
+	struct mtk_device *mtk = ctx->mtk;
+	struct mtk_sa_variant *v;
+	int i;
+
+	spin_lock_bh(&ctx->sa_lock);
+	for (i = 0; i < MTK_SA_CACHE_SIZE; i++) {
+		v = &ctx->sa_cache[i];
+		if (!v->key)
+			continue;
+
+		dma_pool_free(mtk->sa_pool, v->sa, v->sa_base);
+		v->key = 0;
+	}
+	spin_unlock_bh(&ctx->sa_lock);
+}
+
+/*
+ * Keep the end of the AES key schedule, so decrypt SAs can start the
+ * inverse cipher with aesDecKey instead of the engine expanding the key
+ * again for every packet. CTR only runs the cipher forward.
+ */
+static void mtk_ctx_aes_deckey(struct mtk_cipher_ctx *ctx,
+				const struct crypto_aes_ctx *aes,
+				unsigned int keylen, unsigned long int flags)
+{
+	u32 words = keylen / sizeof(u32);
+	/* schedule is 4 * (rounds + 1) words with rounds = 6 + words */
+	u32 last = 4 * (7 + words);
+	u32 i;
+
+	if (!IS_AES(flags) || !(IS_ECB(flags) || IS_CBC(flags)))
+		return;
+
+	for (i = 0; i < words; i++)
+		put_unaligned_le32(aes->key_enc[last - words + i],
+					ctx->dec_key + i * sizeof(u32));
+
+	ctx->dec_keylen = keylen;
+}
+
+static void mtk_sa_variant_build(struct mtk_cipher_ctx *ctx,
+				struct saRecord_s *sa, u32 key,
+				unsigned long int flags)
+{
+	bool chain = key & MTK_SA_CHAIN;
+
+	memcpy(sa, ctx->sa, sizeof(struct saRecord_s));
+
+	if (key & MTK_SA_DECRYPT) {
+		sa->saCmd0.bits.direction = 1;
+		if (ctx->dec_keylen) {
+			memcpy(sa->saKey, ctx->dec_key, ctx->dec_keylen);
+			sa->saCmd1.bits.aesDecKey = 1;
+		}
+	}
+
+	if (ctx->aead) {
+		sa->saCmd1.bits.hashCryptOffset = MTK_SA_ASSOCLEN(key) / 4;
+		sa->saCmd0.bits.digestLength = MTK_SA_AUTHSIZE(key) / 4;
+		/* the digest goes out with the data, state only links segments */
+		if (!chain)
+			sa->saCmd0.bits.saveHash = 0;
+		/* pick up the inner digest where the previous descriptor left */
+		if (key & MTK_SA_CONT)
+			sa->saCmd0.bits.hashSource = 1;
+	}
+
+	/* ECB has no IV; RFC3686 returns none, so only segments need it */
+	if (IS_ECB(flags) || (IS_RFC3686(flags) && !chain))
+		sa->saCmd0.bits.saveIv = 0;
+}
+
+/*
+ * SA record for a request: a prepared variant of the tfm's SA, looked up
+ * without locking. A missing variant is built once; when the cache is full
+ * NULL is returned and the caller builds a record for this request only.
+ */
+static struct mtk_sa_variant *mtk_sa_variant(struct mtk_cipher_ctx *ctx,
+				u32 key, unsigned long int flags)
+{
+	struct mtk_device *mtk = ctx->mtk;
+	struct mtk_sa_variant *v, *free = NULL;
+	int i;
+
+	for (i = 0; i < MTK_SA_CACHE_SIZE; i++) {
+		v = &ctx->sa_cache[i];
+		if (smp_load_acquire(&v->key) == key)
+			return v;
+	}
+
+	spin_lock_bh(&ctx->sa_lock);
+	for (i = 0; i < MTK_SA_CACHE_SIZE; i++) {
+		v = &ctx->sa_cache[i];
+		if (v->key == key)
+			goto out;
+		if (!v->key && !free)
+			free = v;
+	}
+
+	v = free;
+	if (!v)
+		goto out;
+
+	v->sa = dma_pool_alloc(mtk->sa_pool, GFP_ATOMIC, &v->sa_base);
+	if (!v->sa) {
+		v = NULL;
+		goto out;
+	}
+
+	mtk_sa_variant_build(ctx, v->sa, key, flags);
+	/* the record is complete before the key makes it visible */
+	smp_store_release(&v->key, key);
+out:
+	spin_unlock_bh(&ctx->sa_lock);
+
+	return v;
+}
+
+/*
+ * Bytes from @sg on that are contiguous in bus address space, merged over
+ * as many entries as fit one descriptor. *last is set to the final entry.
+ */
+static u32 mtk_sg_run(struct scatterlist *sg, struct scatterlist **last)
+{
+	struct scatterlist *next;
+	u32 len = sg_dma_len(sg);
+
+	while ((next = sg_next(sg)) && sg_dma_len(next) &&
+	       sg_dma_address(next) == sg_dma_address(sg) + sg_dma_len(sg) &&
+	       len + sg_dma_len(next) <= MTK_DESC_MAX_LEN) {
+		len += sg_dma_len(next);
+		sg = next;
+	}
+
+	*last = sg;
+
+	return len;
 }
 
 /*
  * Poor mans Scatter/gather function:
  * Create a Descriptor for every segment to avoid copying buffers.
  * For performance better to wait for hardware to perform multiple DMA
+ * Segments longer than MTK_DESC_CHUNK take several descriptors.
  *
+ * Called with wptr == NULL it only counts the descriptors needed, so the
+ * caller can reserve all ring slots for the request in one go. When
+ * filling, it never writes more than max_desc slots past *wptr.
+ *
+ * Descriptors are copies of @tmpl with addresses and length filled in.
+ * With @cont, the descriptors after the first are copies of it, and only
+ * the last one finishes the hash.
  */
-inline int mtk_scatter_combine(struct mtk_device *mtk, dma_addr_t saRecord_base,
-			dma_addr_t saState_base, struct scatterlist *sgsrc,
-			struct scatterlist *sgdst, u32 datalen,  bool complete,
-			unsigned int *areq, int *commands, int *results)
+inline int mtk_scatter_combine(struct mtk_device *mtk,
+			const struct eip93_descriptor_s *tmpl,
+			const struct eip93_descriptor_s *cont,
+			struct scatterlist *sgsrc, struct scatterlist *sgdst,
+			u32 datalen, unsigned int *areq,
+			u32 *wptr, u32 saPointer, int max_desc,
+			int *commands, int *results)
 {
 	struct mtk_desc_buf *buf;
 	unsigned int remainin, remainout;
@@ -209,142 +721,201 @@ inline int mtk_scatter_combine(struct mtk_device *mtk, dma_addr_t saRecord_base,
 	dma_addr_t saddr, daddr;
 	bool nextin = false;
 	bool nextout = false;
-	struct eip93_descriptor_s *cdesc;
-	struct eip93_descriptor_s *rdesc;
+	struct eip93_descriptor_s desc;
 	int ndesc_cdr = 0, ndesc_rdr = 0;
-	int wptr, saPointer;
 
 	n = datalen;
-	remainin = min(sg_dma_len(sgsrc), n);
-	remainout = min(sg_dma_len(sgdst), n);
+	/* physically contiguous entries share one descriptor */
 	saddr = sg_dma_address(sgsrc);
 	daddr = sg_dma_address(sgdst);
-	saPointer = mtk_ring_curr_wptr_index(mtk);
+	remainin = min(mtk_sg_run(sgsrc, &sgsrc), n);
+	remainout = min(mtk_sg_run(sgdst, &sgdst), n);
 
 	do {
 		if (nextin) {
 			sgsrc = sg_next(sgsrc);
-			remainin = min(sg_dma_len(sgsrc), n);
+			saddr = sg_dma_address(sgsrc);
+			remainin = min(mtk_sg_run(sgsrc, &sgsrc), n);
 			if (remainin == 0)
 				continue;
 
-			saddr = sg_dma_address(sgsrc);
 			offsetin = 0;
 			nextin = false;
 		}
 
 		if (nextout) {
 			sgdst = sg_next(sgdst);
-			remainout = min(sg_dma_len(sgdst), n);
+			daddr = sg_dma_address(sgdst);
+			remainout = min(mtk_sg_run(sgdst, &sgdst), n);
 			if (remainout == 0)
 				continue;
 
-			daddr = sg_dma_address(sgdst);
 			offsetout = 0;
 			nextout = false;
 		}
-		if (remainin == remainout) {
-			len = remainin;
-				nextin = true;
-				nextout = true;
-		} else if (remainin < remainout) {
-			len = remainin;
-				offsetout += len;
-				remainout -= len;
-				nextin = true;
-		} else {
-			len = remainout;
-				offsetin += len;
-				remainin -= len;
-				nextout = true;
+		/* cut long runs so the state carries over between chunks */
+		len = min3(remainin, remainout, (u32)MTK_DESC_CHUNK);
+
+		if (wptr) {
+			if (ndesc_cdr == max_desc)
+				return -ENOSPC;
+
+			desc = (ndesc_cdr && cont) ? *cont : *tmpl;
+			desc.srcAddr = saddr + offsetin;
+			desc.dstAddr = daddr + offsetout;
+			desc.peLength.bits.length = len;
+			if (cont && len == n)
+				desc.peCrtlStat.bits.hashFinal = 1;
+			mtk_ring_write_desc(mtk, *wptr, &desc);
+			buf = &mtk->ring[0].dma_buf[*wptr];
+			buf->flags = MTK_DESC_ASYNC;
+			buf->req = areq;
+			buf->saPointer = saPointer;
+			*wptr = mtk_ring_next_index(mtk, *wptr);
 		}
-
-		rdesc = mtk_add_rdesc(mtk, &wptr);
-		if (IS_ERR(rdesc))
-			dev_err(mtk->dev, "No RDR mem");
-
-		cdesc = mtk_add_cdesc(mtk, &wptr);
-		if (IS_ERR(cdesc))
-			dev_err(mtk->dev, "No CDR mem");
-
-		cdesc->peCrtlStat.bits.hostReady = 1;
-		cdesc->peCrtlStat.bits.prngMode = 0;
-		cdesc->peCrtlStat.bits.hashFinal = 1;
-		cdesc->peCrtlStat.bits.padCrtlStat = 0;
-		cdesc->peCrtlStat.bits.peReady = 0;
-		cdesc->srcAddr = saddr + offsetin;
-		cdesc->dstAddr = daddr + offsetout;
-		cdesc->saAddr = saRecord_base;
-		cdesc->stateAddr = saState_base;
-		cdesc->arc4Addr = saState_base;
-		cdesc->userId = 0;
-		cdesc->peLength.bits.byPass = 0;
-		cdesc->peLength.bits.length = len;
-		cdesc->peLength.bits.hostReady = 1;
-		buf = &mtk->ring[0].dma_buf[wptr];
-		buf->flags = MTK_DESC_ASYNC;
-		buf->req = areq;
-		buf->saPointer = saPointer;
+		offsetin += len;
+		remainin -= len;
+		nextin = !remainin;
+		offsetout += len;
+		remainout -= len;
+		nextout = !remainout;
 		ndesc_cdr++;
 		ndesc_rdr++;
 		n -= len;
 	} while (n);
 
-	/*
-	 * for skcipher and AEAD complete indicates
-	 * LAST -> all segments have been processed: unmap_dma
-	 * FINISH -> complete the requests
-	 */
-	 buf->flags |= MTK_DESC_LAST;
-
-	 if (complete == true)
-		buf->flags |= MTK_DESC_FINISH;
-
 	*commands = ndesc_cdr;
 	*results = ndesc_rdr;
 
 	return 0;
 }
 
+static void mtk_put_states(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rctx->state); i++) {
+		if (rctx->state[i] < 0)
+			continue;
+
+		mtk_state_put(mtk, rctx->state[i]);
+		rctx->state[i] = -1;
+	}
+}
+
+/* per-request SA records, used when the variant cache is full */
+static void mtk_free_sa(struct mtk_device *mtk, struct mtk_cipher_reqctx *rctx)
+{
+	if (rctx->sa) {
+		dma_pool_free(mtk->sa_pool, rctx->sa, rctx->sa_base);
+		rctx->sa = NULL;
+	}
+
+	if (rctx->sa_cont) {
+		dma_pool_free(mtk->sa_pool, rctx->sa_cont, rctx->sa_cont_base);
+		rctx->sa_cont = NULL;
+	}
+}
+
+inline void mtk_unmap_dma(struct mtk_device *mtk, struct mtk_cipher_reqctx *rctx,
+			struct scatterlist *reqsrc, struct scatterlist *reqdst)
+{
+	u32 len = rctx->assoclen + rctx->textsize;
+	u32 authsize = rctx->authsize;
+
+	mtk_put_states(mtk, rctx);
+	mtk_plan_release(mtk, rctx);
+	mtk_free_sa(mtk, rctx);
+
+	if (!rctx->sg_src && !rctx->sg_dst && reqsrc == reqdst) {
+		dma_unmap_sg(mtk->dev, reqdst, rctx->dst_nents,
+			DMA_BIDIRECTIONAL);
+		return;
+	}
+
+	if (rctx->sg_src)
+		mtk_free_sg_cpy(mtk, &rctx->sg_src, &rctx->bounce[0]);
+	else
+		dma_unmap_sg(mtk->dev, reqsrc, sg_nents(reqsrc),
+				DMA_TO_DEVICE);
+
+	if (rctx->sg_dst)
+		mtk_free_sg_cpy(mtk, &rctx->sg_dst, &rctx->bounce[1]);
+	else
+		dma_unmap_sg(mtk->dev, reqdst, sg_nents(reqdst),
+					DMA_BIDIRECTIONAL);
+}
+
+/* bus address of an entry that scatterwalk_ffwd() made into a bounce sg */
+static void mtk_bounce_ffwd(struct scatterlist *sg, struct scatterlist *bounce,
+				u32 offset)
+{
+	sg_dma_address(sg) = sg_dma_address(bounce) + offset;
+	sg_dma_len(sg) = sg->length;
+}
+
+static int mtk_blksize(unsigned long int flags)
+{
+	switch ((flags & MTK_ALG_MASK))	{
+	case MTK_ALG_AES:
+		return AES_BLOCK_SIZE;
+	case MTK_ALG_DES:
+		return DES_BLOCK_SIZE;
+	case MTK_ALG_3DES:
+		return DES3_EDE_BLOCK_SIZE;
+	}
+
+	return 1;
+}
+
+/*
+ * Upper bound of the descriptors mtk_scatter_combine() builds for @len
+ * bytes over @nsrc and @ndst entries: it cuts at every entry boundary of
+ * either side and every MTK_DESC_CHUNK, plus one for a counter wrap.
+ */
+static u32 mtk_desc_bound(u32 nsrc, u32 ndst, u32 len)
+{
+	return nsrc + ndst + len / MTK_DESC_CHUNK + 1;
+}
+
+/*
+ * Build and publish all descriptors of one request. Ring slots are
+ * reserved lock-free for the whole request, so descriptors of concurrent
+ * requests never interleave. Returns -EINPROGRESS once the request
+ * belongs to the engine; the request must not be touched after that since
+ * it can complete at any time. -EAGAIN means the ring is full and nothing
+ * was kept mapped, so the request can be queued and sent again.
+ */
 inline int mtk_send_req(struct crypto_async_request *base,
-		const struct mtk_cipher_ctx *ctx,
+		struct mtk_cipher_ctx *ctx,
 		struct scatterlist *reqsrc, struct scatterlist *reqdst,
-		const u8 *reqiv, struct mtk_cipher_reqctx *rctx,
-		int *commands, int *results)
+		const u8 *reqiv, struct mtk_cipher_reqctx *rctx)
 {
 	struct mtk_device *mtk = ctx->mtk;
 	int ndesc_cdr = 0, ndesc_rdr = 0, ctr_cdr = 0, ctr_rdr = 0;
-	int offset = 0, err, wptr;
+	int offset = 0, direct, err;
+	u32 wptr, start, ndesc, saPointer, cookie, key;
 	u32 aad = rctx->assoclen;
 	u32 textsize = rctx->textsize;
 	u32 authsize = rctx->authsize;
 	u32 datalen = aad + textsize;
 	u32 totlen_src = datalen;
 	u32 totlen_dst = datalen;
-	struct scatterlist *src, *src_ctr;
-	struct scatterlist *dst, *dst_ctr;
+	struct scatterlist *src, *src_ctr = NULL;
+	struct scatterlist *dst, *dst_ctr = NULL;
 	struct saRecord_s *saRecord;
 	struct saState_s *saState;
-	dma_addr_t saState_base, saRecord_base;
-	u32 start, end, ctr, blocks;
+	struct mtk_sa_variant *variant, *cont;
+	struct eip93_descriptor_s desc, desc_cont;
+	dma_addr_t saState_base, saRecord_base, cont_base = 0;
+	u32 ctr, blocks;
 	unsigned long int flags = rctx->flags;
-	bool overflow;
+	bool overflow, chain, fit;
 	bool complete = true;
 	bool src_align = true, dst_align = true;
 	u32 iv[AES_BLOCK_SIZE / sizeof(u32)];
-	int blksize = 1;
-
-	switch ((flags & MTK_ALG_MASK))	{
-	case MTK_ALG_AES:
-		blksize = AES_BLOCK_SIZE;
-		break;
-	case MTK_ALG_DES:
-		blksize = DES_BLOCK_SIZE;
-		break;
-	case MTK_ALG_3DES:
-		blksize = DES3_EDE_BLOCK_SIZE;
-		break;
-	}
+	int blksize = mtk_blksize(flags);
 
 	if (ctx->aead) {
 		if (IS_ENCRYPT(flags))
@@ -358,6 +929,19 @@ inline int mtk_send_req(struct crypto_async_request *base,
 			return -EINVAL;
 	}
 
+	/*
+	 * past MTK_DESC_CHUNK the first descriptor is a whole number of hash
+	 * blocks, its cipher part only ends on a block with the AAD on one
+	 */
+	if (ctx->aead && datalen > MTK_DESC_CHUNK && !IS_ALIGNED(aad, blksize))
+		return -EINVAL;
+
+	rctx->sa = NULL;
+	rctx->sa_cont = NULL;
+	rctx->state[0] = -1;
+	rctx->state[1] = -1;
+	rctx->plan.npieces = 0;
+	rctx->plan.held = false;
 	rctx->sg_src = NULL;
 	src = reqsrc;
 	rctx->sg_dst = NULL;
@@ -389,17 +973,38 @@ inline int mtk_send_req(struct crypto_async_request *base,
 		}
 	}
 
-	if (ctx->aead) {
+	/*
+	 * a request is reserved in one go and can not take the whole ring:
+	 * when its entries might need that many descriptors it is bounced,
+	 * which leaves one descriptor per MTK_DESC_CHUNK
+	 */
+	fit = mtk_desc_bound(rctx->src_nents, rctx->dst_nents, datalen) <
+							mtk->ring[0].size;
+
+	if (!fit) {
 		src_align = false;
 		dst_align = false;
+	} else if (ctx->aead) {
+		/* bounce what the engine can not hash across descriptors */
+		direct = mtk_aead_direct(src, dst, datalen, aad, authsize,
+								blksize);
+		src_align = direct;
+		dst_align = direct;
 	} else {
 		src_align = mtk_is_sg_aligned(src, totlen_src, blksize);
 		dst_align = mtk_is_sg_aligned(reqdst, totlen_dst, blksize);
 	}
 
+	/* bounce only the blocks that need it, when that is cheaper */
+	if (fit && !ctx->aead && !IS_CTR(flags) && (!src_align || !dst_align) &&
+	    mtk_plan(&rctx->plan, src, dst, datalen, blksize)) {
+		src_align = true;
+		dst_align = true;
+	}
+
 	if (!src_align) {
-		rctx->sg_src = reqsrc;
-		err = mtk_make_sg_cpy(rctx->sg_src, &rctx->sg_src,
+		err = mtk_make_sg_cpy(mtk, reqsrc, &rctx->sg_src,
+					&rctx->bounce[0], &rctx->bounce_sg[0],
 					totlen_src, rctx, true);
 		if (err)
 			return err;
@@ -407,18 +1012,31 @@ inline int mtk_send_req(struct crypto_async_request *base,
 	}
 
 	if (!dst_align) {
-		rctx->sg_dst = reqdst;
-		err = mtk_make_sg_cpy(rctx->sg_dst, &rctx->sg_dst,
+		err = mtk_make_sg_cpy(mtk, reqdst, &rctx->sg_dst,
+					&rctx->bounce[1], &rctx->bounce_sg[1],
 					totlen_dst, rctx, false);
 		if (err)
-			return err;
+			goto free_sg_src;
 		dst = rctx->sg_dst;
 	}
 
+	/* bounce buffers are mapped already */
+	err = -ENOMEM;
 	/* map DMA_BIDIRECTIONAL to invalidate cache on destination */
-	dma_map_sg(mtk->dev, dst, sg_nents(dst), DMA_BIDIRECTIONAL);
-	if (src != dst)
-		dma_map_sg(mtk->dev, src, sg_nents(src), DMA_TO_DEVICE);
+	if (!rctx->sg_dst &&
+	    !dma_map_sg(mtk->dev, dst, sg_nents(dst), DMA_BIDIRECTIONAL))
+		goto free_sg_dst;
+
+	if (src != dst && !rctx->sg_src) {
+		if (!dma_map_sg(mtk->dev, src, sg_nents(src), DMA_TO_DEVICE))
+			goto unmap_dst;
+	}
+
+	if (rctx->plan.npieces) {
+		err = mtk_plan_build(mtk, rctx, reqsrc, &src, &dst);
+		if (err)
+			goto unmap;
+	}
 
 	if (IS_CBC(flags) || IS_CTR(flags))
 		memcpy(iv, reqiv, AES_BLOCK_SIZE);
@@ -430,10 +1048,8 @@ inline int mtk_send_req(struct crypto_async_request *base,
 		blocks = DIV_ROUND_UP(totlen_src, AES_BLOCK_SIZE);
 		ctr = be32_to_cpu(iv[3]);
 		/* Check 32bit counter overflow. */
-		start = ctr;
-		end = start + blocks - 1;
-		if (end < start) {
-			offset = AES_BLOCK_SIZE * -start;
+		if (ctr + blocks - 1 < ctr) {
+			offset = AES_BLOCK_SIZE * -ctr;
 			/*
 		 	* Increment the counter manually to cope with
 		 	* the hardware counter overflow.
@@ -444,25 +1060,108 @@ inline int mtk_send_req(struct crypto_async_request *base,
 			complete = false;
 		}
 	}
-	/*
-	 * Keep all descriptors off 1 request together with desc_lock
-	 * TODO: rethink the logic of handling results.
-	 */
-	spin_lock(&mtk->ring[0].desc_lock);
 
-	wptr = mtk_ring_curr_wptr_index(mtk);
-	saState = &mtk->saState[wptr];
-	saState_base = mtk->saState_base + wptr * sizeof(saState_t);
-	saRecord = &mtk->saRecord[wptr];
-	saRecord_base = mtk->saRecord_base + wptr * sizeof(saRecord_t);
-	memcpy(saRecord, ctx->sa, sizeof(struct saRecord_s));
+	if (unlikely(complete == false)) {
+		mtk_scatter_combine(mtk, NULL, NULL, src, dst, offset,
+				(void *)base, NULL, 0, 0, &ctr_cdr, &ctr_rdr);
+		/* Jump to offset. */
+		src_ctr = src;
+		dst_ctr = dst;
+		src = scatterwalk_ffwd(rctx->ctr_src, src_ctr, offset);
+		dst = ((src_ctr == dst_ctr) ? src :
+			scatterwalk_ffwd(rctx->ctr_dst, dst_ctr, offset));
+		datalen -= offset;
+		/* map DMA_BIDIRECTIONAL to invalidate cache on destination */
+		err = -ENOMEM;
+		if (rctx->sg_dst)
+			mtk_bounce_ffwd(dst, dst_ctr, offset);
+		else if (!dma_map_sg(mtk->dev, dst, sg_nents(dst),
+						DMA_BIDIRECTIONAL))
+			goto unmap;
+		if (src != dst) {
+			if (rctx->sg_src)
+				mtk_bounce_ffwd(src, src_ctr, offset);
+			else if (!dma_map_sg(mtk->dev, src, sg_nents(src),
+						DMA_TO_DEVICE))
+				goto unmap;
+		}
+	}
+
+	mtk_scatter_combine(mtk, NULL, NULL, src, dst, datalen,
+			(void *)base, NULL, 0, 0, &ndesc_cdr, &ndesc_rdr);
 
-	if (IS_DECRYPT(flags))
-		saRecord->saCmd0.bits.direction = 1;
+	ndesc = ndesc_cdr + ctr_cdr;
 
-	if (ctx->aead) {
-		saRecord->saCmd0.bits.opCode = 1;
+	/* state only has to carry over between segments for these */
+	chain = ndesc > 1 && (ctx->aead || IS_RFC3686(flags));
+	key = MTK_SA_KEY((IS_DECRYPT(flags) ? MTK_SA_DECRYPT : 0) |
+			(chain ? MTK_SA_CHAIN : 0), authsize, aad);
+	variant = NULL;
+	if (aad <= GENMASK(15, 0))
+		variant = mtk_sa_variant(ctx, key, flags);
+
+	if (variant) {
+		saRecord = variant->sa;
+		saRecord_base = variant->sa_base;
+	} else {
+		err = -ENOMEM;
+		rctx->sa = dma_pool_alloc(mtk->sa_pool, GFP_ATOMIC,
+						&rctx->sa_base);
+		if (!rctx->sa)
+			goto unmap;
+
+		mtk_sa_variant_build(ctx, rctx->sa, key, flags);
+		rctx->sa->saCmd1.bits.hashCryptOffset = (aad / 4);
+		saRecord = rctx->sa;
+		saRecord_base = rctx->sa_base;
+	}
+
+	/* AEAD over several descriptors: the later ones continue the hash */
+	if (ctx->aead && ndesc > 1) {
+		key = MTK_SA_KEY(MTK_SA_CHAIN | MTK_SA_CONT | (IS_DECRYPT(flags) ?
+				MTK_SA_DECRYPT : 0), authsize, 0);
+		cont = mtk_sa_variant(ctx, key, flags);
+		if (cont) {
+			cont_base = cont->sa_base;
+		} else {
+			err = -ENOMEM;
+			rctx->sa_cont = dma_pool_alloc(mtk->sa_pool, GFP_ATOMIC,
+							&rctx->sa_cont_base);
+			if (!rctx->sa_cont)
+				goto unmap;
+
+			mtk_sa_variant_build(ctx, rctx->sa_cont, key, flags);
+			cont_base = rctx->sa_cont_base;
+		}
+	}
+
+	/* out of states behaves like a full ring: the request is queued */
+	rctx->state[0] = mtk_state_get(mtk);
+	if (rctx->state[0] < 0) {
+		err = rctx->state[0];
+		goto unmap;
 	}
+
+	if (unlikely(complete == false)) {
+		rctx->state[1] = mtk_state_get(mtk);
+		if (rctx->state[1] < 0) {
+			err = rctx->state[1];
+			goto unmap;
+		}
+	}
+
+	/* admit the request with all its slots, or push back */
+	err = mtk_ring_reserve(mtk, ndesc, &start);
+	if (err)
+		goto unmap;
+
+	wptr = start;
+	saPointer = rctx->state[0];
+	cookie = mtk_ring_cookie(mtk, start, ndesc);
+	if (base == READ_ONCE(mtk->ring[0].poll_req))
+		mtk->ring[0].poll_cookie = cookie;
+	saState = mtk_state(mtk, saPointer);
+	saState_base = mtk_state_base(mtk, saPointer);
 /*
 	if (IS_GENIV(flags)) {
 		printk("geniv");
@@ -475,218 +1174,562 @@ inline int mtk_send_req(struct crypto_async_request *base,
 			saRecord->saCmd0.bits.ivSource = 1;
 	}
 */
-	if (IS_HMAC(flags)) {
-		saRecord->saCmd1.bits.hashCryptOffset = (aad / 4);
-		saRecord->saCmd0.bits.digestLength = (authsize / 4);
-	}
-
 	if (IS_CBC(flags) || overflow)
 		memcpy(saState->stateIv, reqiv, AES_BLOCK_SIZE);
 	else if (IS_RFC3686(flags)) {
-		saState->stateIv[0] = ctx->sa->saNonce;
+		saState->stateIv[0] = saRecord->saNonce;
 		saState->stateIv[1] = iv[0];
 		saState->stateIv[2] = iv[1];
 		saState->stateIv[3] = cpu_to_be32(1);
 	}
 
-	/* TODO: check logic for wptr in case multiple requests */
+	/* the tfm's control words plus this request's SA, state and cookie */
+	desc = ctx->desc;
+	desc.saAddr = saRecord_base;
+	desc.stateAddr = saState_base;
+	desc.arc4Addr = saState_base;
+	desc.userId = cookie;
+	if (cont_base) {
+		/* one hash over all descriptors, finished by the last one */
+		desc.peCrtlStat.bits.hashFinal = 0;
+		desc_cont = desc;
+		desc_cont.saAddr = cont_base;
+	}
+
 	if (unlikely(complete == false)) {
-		src_ctr = src;
-		dst_ctr = dst;
-		err = mtk_scatter_combine(mtk, saRecord_base,
-				saState_base, src, dst,
-				offset, complete, (void *)base,
+		err = mtk_scatter_combine(mtk, &desc, NULL, src_ctr, dst_ctr,
+				offset, (void *)base,
+				&wptr, saPointer, ndesc,
 				&ctr_cdr, &ctr_rdr);
-		/* Jump to offset. */
-		src = scatterwalk_ffwd(rctx->ctr_src, src_ctr, offset);
-		dst = ((src_ctr == dst_ctr) ? src :
-			scatterwalk_ffwd(rctx->ctr_dst, dst_ctr, offset));
+		if (err) {
+			dev_err(mtk->dev, "counter descriptors overrun reservation\n");
+			goto rollback;
+		}
 		/* Set new State */
-		wptr = mtk_ring_curr_wptr_index(mtk);
-		saState = &mtk->saState[wptr];
-		saState_base = mtk->saState_base + wptr * sizeof(saState_t);
+		saPointer = rctx->state[1];
+		saState = mtk_state(mtk, saPointer);
+		saState_base = mtk_state_base(mtk, saPointer);
 		memcpy(saState->stateIv, iv, AES_BLOCK_SIZE);
-		datalen -= offset;
-		complete = true;
-		/* map DMA_BIDIRECTIONAL to invalidate cache on destination */
-		dma_map_sg(mtk->dev, dst, sg_nents(dst), DMA_BIDIRECTIONAL);
-		if (src != dst)
-			dma_map_sg(mtk->dev, src, sg_nents(src), DMA_TO_DEVICE);
+		desc.stateAddr = saState_base;
+		desc.arc4Addr = saState_base;
 	}
 
-	err = mtk_scatter_combine(mtk, saRecord_base,
-			saState_base, src, dst,
-			datalen, complete, (void *)base,
+	err = mtk_scatter_combine(mtk, &desc, cont_base ? &desc_cont : NULL,
+			src, dst, datalen, (void *)base,
+			&wptr, saPointer, ndesc - ctr_cdr,
 			&ndesc_cdr, &ndesc_rdr);
+	if (err || ndesc_cdr + ctr_cdr != ndesc) {
+		dev_err(mtk->dev, "descriptors do not match reservation\n");
+		err = -EINVAL;
+		goto rollback;
+	}
 
-	spin_unlock(&mtk->ring[0].desc_lock);
+	mtk_ring_publish(mtk, start, ndesc);
 
-	*commands = ndesc_cdr + ctr_cdr;
-	*results = ndesc_rdr + ctr_rdr;
+	return -EINPROGRESS;
 
-	return 0;
+rollback:
+	mtk_ring_rollback(mtk, start, ndesc);
+unmap:
+	mtk_unmap_dma(mtk, rctx, reqsrc, reqdst);
+
+	return err;
+
+unmap_dst:
+	if (!rctx->sg_dst)
+		dma_unmap_sg(mtk->dev, dst, sg_nents(dst), DMA_BIDIRECTIONAL);
+free_sg_dst:
+	mtk_free_sg_cpy(mtk, &rctx->sg_dst, &rctx->bounce[1]);
+free_sg_src:
+	mtk_free_sg_cpy(mtk, &rctx->sg_src, &rctx->bounce[0]);
+
+	return err;
 }
 
+/*
+ * Unmap and copy back a request whose descriptors have all been retired;
+ * @saPointer is the saState of its last descriptor. Returns @err,
+ * the status collected from the result descriptors.
+ */
 inline int mtk_req_result(struct mtk_device *mtk, struct mtk_cipher_reqctx *rctx,
 		struct scatterlist *reqsrc, struct scatterlist *reqdst,
-		u8 *reqiv, bool *should_complete, int *ret)
+		u8 *reqiv, u32 saPointer, int err)
 {
-	struct eip93_descriptor_s *cdesc;
-	struct eip93_descriptor_s *rdesc;
-	struct mtk_desc_buf *buf;
-	struct crypto_async_request *req = NULL;
 	struct saState_s *saState;
-	u32 saPointer;
-	int ndesc = 0, rptr = 0, nreq;
-	int try, i;
-	volatile int done1, done2;
-	bool last_entry = false;
 	u32 aad = rctx->assoclen;
 	u32 len = aad + rctx->textsize;
 	u32 authsize = rctx->authsize;
-	u32 auth = 0;
-	u32 *otag;
+	u32 tag[SHA256_DIGEST_SIZE / sizeof(u32)];
 
-	*ret = 0;
-	*should_complete = false;
+	mtk_free_sa(mtk, rctx);
 
-	nreq = readl(mtk->base + EIP93_REG_PE_RD_COUNT) & GENMASK(10, 0);
+	if (!rctx->sg_src && !rctx->sg_dst && reqsrc == reqdst) {
+		dma_unmap_sg(mtk->dev, reqdst, rctx->dst_nents,
+			DMA_BIDIRECTIONAL);
+		goto direct;
+	}
 
-	spin_lock(&mtk->ring[0].rdesc_lock);
-	while (ndesc < nreq) {
-		rdesc = mtk_ring_next_rptr(mtk, &mtk->ring[0].rdr, &rptr);
-		if (IS_ERR(rdesc)) {
-			dev_err(mtk->dev, "Ndesc: %d nreq: %d\n", ndesc, nreq);
-			*ret = PTR_ERR(rdesc);
-			break;
-		}
-		/* make sure EIP93 finished writing all data
-		 * (volatile int) used since bits will be updated via DMA
-		*/
-		try = 0;
-		while (try < 1000) {
-			done1 = (volatile int)rdesc->peCrtlStat.bits.peReady;
-			done2 = (volatile int)rdesc->peLength.bits.peReady;
-			if ((!done1) || (!done2)) {
-					try++;
-					cpu_relax();
-					continue;
-			}
-			break;
-		}
-		/*
-		if (try)
-			dev_err(mtk->dev, "EIP93 try-count: %d", try);
-		*/
-
-		if (rdesc->peCrtlStat.bits.errStatus) {
-			dev_err(mtk->dev, "Err: %02x\n",
-					rdesc->peCrtlStat.bits.errStatus);
-			*ret = -EINVAL;
-		}
+	if (rctx->sg_src)
+		mtk_free_sg_cpy(mtk, &rctx->sg_src, &rctx->bounce[0]);
+	else
+		dma_unmap_sg(mtk->dev, reqsrc, sg_nents(reqsrc),
+				DMA_TO_DEVICE);
 
-		cdesc = mtk_ring_next_rptr(mtk, &mtk->ring[0].cdr, &rptr);
-		if (IS_ERR(cdesc)) {
-			dev_err(mtk->dev, "Cant get Cdesc");
-			*ret = PTR_ERR(cdesc);
-			break;
-		}
+	if (rctx->sg_dst) {
+		mtk_bounce_to_cpu(mtk, &rctx->bounce[1]);
+		sg_copy_from_buffer(reqdst, sg_nents(reqdst),
+				sg_virt(rctx->sg_dst), len);
+		/* decrypt has no tag to hand back */
+		if (authsize && IS_ENCRYPT(rctx->flags))
+			mtk_aead_put_tag(reqdst, len, sg_virt(rctx->sg_dst) + len,
+					authsize, rctx->flags);
+		mtk_free_sg_cpy(mtk, &rctx->sg_dst, &rctx->bounce[1]);
+		goto update_iv;
+	}
 
-		buf = &mtk->ring[0].dma_buf[rptr];
-		if (buf->flags & MTK_DESC_FINISH)
-			*should_complete = true;
-		if (buf->flags & MTK_DESC_LAST)
-			last_entry = true;
-		buf->flags = 0;
-		ndesc++;
-		if (last_entry)
-			break;
+	/* mapped DMA_BIDIRECTIONAL, see mtk_send_req() */
+	dma_unmap_sg(mtk->dev, reqdst, sg_nents(reqdst), DMA_BIDIRECTIONAL);
+
+	/* straight to the caller's buffers, apart from stitched pieces */
+direct:
+	mtk_plan_finish(mtk, rctx, reqdst);
+
+	/* zero-copy AEAD: the tag went straight to the caller's buffer */
+	if (authsize && IS_ENCRYPT(rctx->flags) && !IS_HASH_MD5(rctx->flags)) {
+		scatterwalk_map_and_copy(tag, reqdst, len, authsize, 0);
+		mtk_aead_put_tag(reqdst, len, tag, authsize, rctx->flags);
+	}
+
+	/* API expects updated IV for CBC and CTR (no RFC3686) */
+update_iv:
+	if ((!IS_RFC3686(rctx->flags)) &&
+		(IS_CBC(rctx->flags) || IS_CTR(rctx->flags))) {
+		saState = mtk_state(mtk, saPointer);
+		memcpy(reqiv, saState->stateIv, rctx->ivsize);
 	}
-	spin_unlock(&mtk->ring[0].rdesc_lock);
 
-	if (!last_entry)
-		return ndesc;
+	mtk_put_states(mtk, rctx);
 
-	if (!rctx->sg_src && !rctx->sg_dst && reqsrc == reqdst) {
-		dma_unmap_sg(mtk->dev, reqdst, rctx->dst_nents,
-			DMA_BIDIRECTIONAL);
-		goto update_iv;
+	return err;
+}
+
+/*
+ * Streaming: a large skcipher request is mapped and sent in windows, so
+ * the cache maintenance of the next window runs while the engine works on
+ * the current one, and each window is unmapped as soon as it is done. All
+ * windows share one saState, which carries the IV from one to the next.
+ */
+
+/*
+ * View of @len bytes of @sg from @offset on, as copies of its entries
+ * clamped at both ends of the window: with two windows in flight no byte
+ * may be mapped by both. Takes at most @segs entries and returns the
+ * bytes covered, less than @len when it runs out of them.
+ */
+static u32 mtk_stream_view(struct scatterlist *view, struct scatterlist *sg,
+				u32 offset, u32 len, u32 segs)
+{
+	u32 n, done = 0;
+	int i;
+
+	while (offset >= sg->length) {
+		offset -= sg->length;
+		sg = sg_next(sg);
 	}
 
-	if (rctx->sg_src) {
-		dma_unmap_sg(mtk->dev, rctx->sg_src,
-			sg_nents(rctx->sg_src), DMA_TO_DEVICE);
-		mtk_free_sg_cpy(len + authsize, &rctx->sg_src);
-	} else
-		dma_unmap_sg(mtk->dev, reqsrc, sg_nents(reqsrc),
+	sg_init_table(view, MTK_STREAM_SEGS);
+	for (i = 0; sg && i < segs && done < len; i++) {
+		n = min(sg->length - offset, len - done);
+		sg_set_page(&view[i], sg_page(sg), n, sg->offset + offset);
+		done += n;
+		offset = 0;
+		sg = sg_next(sg);
+	}
+	sg_mark_end(&view[i - 1]);
+
+	return done;
+}
+
+/*
+ * Entries per side of a window, so that MTK_STREAM_DEPTH windows fit the
+ * ring at once also at its smallest size; see mtk_desc_bound().
+ */
+static u32 mtk_stream_segs(struct mtk_device *mtk)
+{
+	u32 cap = (mtk->ring[0].size - 1) / MTK_STREAM_DEPTH;
+
+	return clamp_t(u32, (cap - MTK_STREAM_WINDOW / MTK_DESC_CHUNK - 1) / 2,
+			1, MTK_STREAM_SEGS);
+}
+
+static void mtk_stream_unmap(struct mtk_device *mtk, struct mtk_stream *s,
+				int w)
+{
+	if (s->win_src[w] != s->win_dst[w])
+		dma_unmap_sg(mtk->dev, s->win_src[w], s->nents_src[w],
 				DMA_TO_DEVICE);
 
-	if (rctx->sg_dst) {
-		dma_unmap_sg(mtk->dev, rctx->sg_dst,
-			sg_nents(rctx->sg_dst), DMA_FROM_DEVICE);
-		/* EIP93 Little endian MD5; Big Endian all SHA */
-		if (authsize) {
-			if (!IS_HASH_MD5(rctx->flags)) {
-				otag = sg_virt(rctx->sg_dst) + len;
-				for (i = 0; i < (authsize / 4); i++)
-					otag[i] = ntohl(otag[i]);
+	dma_unmap_sg(mtk->dev, s->win_dst[w], s->nents_dst[w],
+			DMA_BIDIRECTIONAL);
+}
+
+/*
+ * Map and send windows until MTK_STREAM_DEPTH are in flight or all of the
+ * request is out. Each window is a request of its own on the ring.
+ * Called with s->lock held; -EAGAIN when the ring is full.
+ */
+static int mtk_stream_fill(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx)
+{
+	struct mtk_stream *s = &rctx->stream;
+	struct scatterlist *src, *dst;
+	u32 len, n, start, wptr, ndesc, segs = mtk_stream_segs(mtk);
+	int w, ndesc_cdr, ndesc_rdr, err;
+
+	while (s->sent < s->len && s->nsent - s->ndone < MTK_STREAM_DEPTH) {
+		w = s->nsent % MTK_STREAM_DEPTH;
+		len = min_t(u32, s->len - s->sent, MTK_STREAM_WINDOW);
+
+		/* a window ends where either side runs out of entries */
+		dst = s->view_dst[w];
+		len = mtk_stream_view(dst, s->dst, s->sent, len, segs);
+		src = dst;
+		if (s->src != s->dst) {
+			src = s->view_src[w];
+			n = mtk_stream_view(src, s->src, s->sent, len, segs);
+			if (n < len)
+				len = mtk_stream_view(dst, s->dst, s->sent, n,
+							segs);
+		}
+
+		/* map DMA_BIDIRECTIONAL to invalidate cache on destination */
+		s->nents_dst[w] = sg_nents(dst);
+		if (!dma_map_sg(mtk->dev, dst, s->nents_dst[w],
+					DMA_BIDIRECTIONAL))
+			return -ENOMEM;
+
+		if (src != dst) {
+			s->nents_src[w] = sg_nents(src);
+			if (!dma_map_sg(mtk->dev, src, s->nents_src[w],
+						DMA_TO_DEVICE)) {
+				dma_unmap_sg(mtk->dev, dst, s->nents_dst[w],
+						DMA_BIDIRECTIONAL);
+				return -ENOMEM;
 			}
 		}
-		if (IS_ENCRYPT(rctx->flags))
-			auth = authsize;
+		s->win_src[w] = src;
+		s->win_dst[w] = dst;
 
-		sg_copy_from_buffer(reqdst, sg_nents(reqdst),
-				sg_virt(rctx->sg_dst), len + auth);
-		mtk_free_sg_cpy(len + authsize, &rctx->sg_dst);
-	} else
-		dma_unmap_sg(mtk->dev, reqdst, sg_nents(reqdst),
-					DMA_FROM_DEVICE);
+		mtk_scatter_combine(mtk, NULL, NULL, src, dst, len,
+				(void *)s->req, NULL, 0, 0,
+				&ndesc_cdr, &ndesc_rdr);
+		ndesc = ndesc_cdr;
 
-	if (!*should_complete)
-		return ndesc;
+		err = mtk_ring_reserve(mtk, ndesc, &start);
+		if (err)
+			goto unmap;
+
+		wptr = start;
+		s->desc.userId = mtk_ring_cookie(mtk, start, ndesc);
+		err = mtk_scatter_combine(mtk, &s->desc, NULL, src, dst,
+				len, (void *)s->req, &wptr,
+				rctx->state[0], ndesc,
+				&ndesc_cdr, &ndesc_rdr);
+		if (err || ndesc_cdr != ndesc) {
+			dev_err(mtk->dev, "descriptors do not match reservation\n");
+			mtk_ring_rollback(mtk, start, ndesc);
+			err = -EINVAL;
+			goto unmap;
+		}
+
+		mtk_ring_publish(mtk, start, ndesc);
+		s->sent += len;
+		s->nsent++;
+	}
+
+	return 0;
+
+unmap:
+	mtk_stream_unmap(mtk, s, w);
+
+	return err;
+}
+
+static int mtk_stream_finish(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx, u8 *reqiv)
+{
+	struct saState_s *saState;
 
-	/* API expects updated IV for CBC and CTR (no RFC3686) */
-update_iv:
 	if ((!IS_RFC3686(rctx->flags)) &&
 		(IS_CBC(rctx->flags) || IS_CTR(rctx->flags))) {
-		saPointer = buf->saPointer;
-		saState = &mtk->saState[saPointer];
+		saState = mtk_state(mtk, rctx->state[0]);
 		memcpy(reqiv, saState->stateIv, rctx->ivsize);
 	}
 
-	if (IS_BUSY(rctx->flags)) {
-		req = (struct crypto_async_request *)buf->req;
-		local_bh_disable();
-		req->complete(req, -EINPROGRESS);
-		local_bh_enable();
+	mtk_put_states(mtk, rctx);
+	mtk_free_sa(mtk, rctx);
+	rctx->stream.len = 0;
+
+	return rctx->stream.err;
+}
+
+/*
+ * Send what fits and report: -EINPROGRESS while windows are in flight,
+ * -EAGAIN when none are and the ring is full, otherwise the request is
+ * over and its status is returned. With nothing in flight no completion
+ * can race with the caller, so the request is safe to touch after -EAGAIN.
+ */
+static int mtk_stream_step(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx, u8 *reqiv)
+{
+	struct mtk_stream *s = &rctx->stream;
+	bool busy;
+	int err = 0;
+
+	spin_lock_bh(&s->lock);
+	if (!s->err)
+		err = mtk_stream_fill(mtk, rctx);
+	if (err && err != -EAGAIN)
+		s->err = err;
+	busy = s->nsent != s->ndone;
+	spin_unlock_bh(&s->lock);
+
+	if (busy)
+		return -EINPROGRESS;
+
+	if (err == -EAGAIN)
+		return err;
+
+	return mtk_stream_finish(mtk, rctx, reqiv);
+}
+
+/*
+ * Streamed when the request can go to the engine as it is: no bounce
+ * buffers, and for CTR no counter wrap to split at. Large requests are,
+ * and so are smaller ones with too many entries to reserve in one go.
+ */
+static bool mtk_stream_ok(struct mtk_device *mtk,
+				struct mtk_cipher_reqctx *rctx,
+				struct skcipher_request *req)
+{
+	u32 len = req->cryptlen;
+	int blksize = mtk_blksize(rctx->flags);
+	u32 ctr;
+
+	if (len < MTK_STREAM_MIN &&
+	    mtk_desc_bound(sg_nents_for_len(req->src, len),
+			sg_nents_for_len(req->dst, len), len) <
+							mtk->ring[0].size)
+		return false;
+
+	if (IS_CTR(rctx->flags)) {
+		ctr = get_unaligned_be32(req->iv + 12);
+		if (!IS_RFC3686(rctx->flags) &&
+		    ctr + DIV_ROUND_UP(len, AES_BLOCK_SIZE) - 1 < ctr)
+			return false;
+	} else if (!IS_ALIGNED(len, blksize))
+		return false;
+
+	return mtk_is_sg_aligned(req->src, len, blksize) &&
+		mtk_is_sg_aligned(req->dst, len, blksize);
+}
+
+static int mtk_stream_req(struct mtk_cipher_ctx *ctx,
+				struct skcipher_request *req,
+				struct mtk_cipher_reqctx *rctx)
+{
+	struct mtk_device *mtk = ctx->mtk;
+	struct mtk_stream *s = &rctx->stream;
+	struct mtk_sa_variant *variant;
+	struct saRecord_s *saRecord;
+	struct saState_s *saState;
+	unsigned long int flags = rctx->flags;
+	u32 key;
+	int ret;
+
+	rctx->sa = NULL;
+	rctx->sa_cont = NULL;
+	rctx->state[1] = -1;
+
+	/* chained: RFC3686 has to save its counter between windows too */
+	key = MTK_SA_KEY((IS_DECRYPT(flags) ? MTK_SA_DECRYPT : 0) |
+			MTK_SA_CHAIN, 0, 0);
+	variant = mtk_sa_variant(ctx, key, flags);
+	s->desc = ctx->desc;
+	if (variant) {
+		saRecord = variant->sa;
+		s->desc.saAddr = variant->sa_base;
+	} else {
+		rctx->sa = dma_pool_alloc(mtk->sa_pool, GFP_ATOMIC,
+						&rctx->sa_base);
+		if (!rctx->sa)
+			return -ENOMEM;
+
+		mtk_sa_variant_build(ctx, rctx->sa, key, flags);
+		saRecord = rctx->sa;
+		s->desc.saAddr = rctx->sa_base;
+	}
+
+	rctx->state[0] = mtk_state_get(mtk);
+	if (rctx->state[0] < 0) {
+		ret = rctx->state[0];
+		mtk_free_sa(mtk, rctx);
+		return ret;
 	}
 
-	return ndesc;
+	s->desc.stateAddr = mtk_state_base(mtk, rctx->state[0]);
+	s->desc.arc4Addr = s->desc.stateAddr;
+	saState = mtk_state(mtk, rctx->state[0]);
+	if (IS_RFC3686(flags)) {
+		saState->stateIv[0] = saRecord->saNonce;
+		memcpy(&saState->stateIv[1], req->iv, CTR_RFC3686_IV_SIZE);
+		saState->stateIv[3] = cpu_to_be32(1);
+	} else if (IS_CBC(flags) || IS_CTR(flags))
+		memcpy(saState->stateIv, req->iv, rctx->ivsize);
+
+	s->req = &req->base;
+	s->src = req->src;
+	s->dst = req->dst;
+	s->len = req->cryptlen;
+	s->sent = 0;
+	s->nsent = 0;
+	s->ndone = 0;
+	s->err = 0;
+	spin_lock_init(&s->lock);
+
+	ret = mtk_stream_step(mtk, rctx, req->iv);
+	if (ret == -EAGAIN) {
+		/* nothing went out: queue the request, it starts over */
+		mtk_put_states(mtk, rctx);
+		mtk_free_sa(mtk, rctx);
+		s->len = 0;
+	}
+
+	return ret;
+}
+
+/* a window is done: unmap it and send the next */
+static int mtk_stream_result(struct mtk_device *mtk,
+				struct skcipher_request *req, int err)
+{
+	struct mtk_cipher_reqctx *rctx = skcipher_request_ctx(req);
+	struct mtk_stream *s = &rctx->stream;
+	int ret;
+
+	spin_lock_bh(&s->lock);
+	mtk_stream_unmap(mtk, s, s->ndone % MTK_STREAM_DEPTH);
+	s->ndone++;
+	if (err && !s->err)
+		s->err = err;
+	spin_unlock_bh(&s->lock);
+
+	ret = mtk_stream_step(mtk, rctx, req->iv);
+	if (ret == -EAGAIN) {
+		/* no window left to send the rest from: wait for ring space */
+		spin_lock_bh(&mtk->ring[0].queue_lock);
+		list_add_tail(&req->base.list, &mtk->ring[0].streams);
+		spin_unlock_bh(&mtk->ring[0].queue_lock);
+		return -EINPROGRESS;
+	}
+
+	return ret;
+}
+
+/* called from a completion round for a request taken off ring->streams */
+int mtk_stream_resume(struct mtk_device *mtk,
+			struct crypto_async_request *async)
+{
+	struct skcipher_request *req = skcipher_request_cast(async);
+
+	return mtk_stream_step(mtk, skcipher_request_ctx(req), req->iv);
+}
+
+/* skcipher and AEAD requests share the request context layout */
+struct mtk_cipher_reqctx *mtk_async_reqctx(struct crypto_async_request *async)
+{
+	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
+
+	if (ctx->aead)
+		return aead_request_ctx(aead_request_cast(async));
+
+	return skcipher_request_ctx(skcipher_request_cast(async));
+}
+
+int mtk_skcipher_send_req(struct crypto_async_request *async)
+{
+	struct skcipher_request *req = skcipher_request_cast(async);
+	struct mtk_cipher_reqctx *rctx = skcipher_request_ctx(req);
+	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
+
+	rctx->stream.len = 0;
+	/* a polled request has to complete in one go */
+	if (async != READ_ONCE(ctx->mtk->ring[0].poll_req) &&
+	    mtk_stream_ok(ctx->mtk, rctx, req))
+		return mtk_stream_req(ctx, req, rctx);
+
+	return mtk_send_req(async, ctx, req->src, req->dst, req->iv, rctx);
+}
+
+int mtk_aead_send_req(struct crypto_async_request *async)
+{
+	struct aead_request *req = aead_request_cast(async);
+	struct mtk_cipher_reqctx *rctx = aead_request_ctx(req);
+	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
+
+	return mtk_send_req(async, ctx, req->src, req->dst, req->iv, rctx);
 }
 
 int mtk_skcipher_handle_result(struct mtk_device *mtk,
 				struct crypto_async_request *async,
-				bool *should_complete,  int *ret)
+				u32 saPointer, int err)
 {
 	struct skcipher_request *req = skcipher_request_cast(async);
 	struct mtk_cipher_reqctx *rctx = skcipher_request_ctx(req);
 
+	if (rctx->stream.len)
+		return mtk_stream_result(mtk, req, err);
+
 	return mtk_req_result(mtk, rctx, req->src, req->dst, req->iv,
-				should_complete, ret);
+				saPointer, err);
 }
 
 int mtk_aead_handle_result(struct mtk_device *mtk,
 				struct crypto_async_request *async,
-				bool *should_complete,  int *ret)
+				u32 saPointer, int err)
 {
 	struct aead_request *req = aead_request_cast(async);
 	struct mtk_cipher_reqctx *rctx = aead_request_ctx(req);
 
 	return mtk_req_result(mtk, rctx, req->src, req->dst, req->iv,
-				should_complete, ret);
+				saPointer, err);
+}
+
+static int mtk_cipher_sa_alloc(struct mtk_cipher_ctx *ctx)
+{
+	ctx->sa = kzalloc(sizeof(struct saRecord_s), GFP_KERNEL);
+	if (!ctx->sa)
+		return -ENOMEM;
+
+	spin_lock_init(&ctx->sa_lock);
+
+	return 0;
+}
+
+static void mtk_cipher_sa_free(struct mtk_cipher_ctx *ctx)
+{
+	mtk_sa_cache_flush(ctx);
+	kfree(ctx->sa);
 }
 
 /* Crypto skcipher API functions */
+/* control words of every descriptor of the tfm, see mtk_send_req() */
+static void mtk_desc_template(struct mtk_cipher_ctx *ctx)
+{
+	ctx->desc.peCrtlStat.bits.hostReady = 1;
+	ctx->desc.peCrtlStat.bits.hashFinal = 1;
+	ctx->desc.peLength.bits.hostReady = 1;
+}
+
 static int mtk_skcipher_cra_init(struct crypto_tfm *tfm)
 {
 	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(tfm);
@@ -699,11 +1742,12 @@ static int mtk_skcipher_cra_init(struct crypto_tfm *tfm)
 				sizeof(struct mtk_cipher_reqctx));
 
 	ctx->mtk = tmpl->mtk;
+	ctx->base.send_req = mtk_skcipher_send_req;
 	ctx->base.handle_result = mtk_skcipher_handle_result;
 	ctx->aead = false;
-	ctx->sa = kzalloc(sizeof(struct saRecord_s), GFP_KERNEL);
-	if (!ctx->sa)
-		printk("!! no sa memory\n");
+	mtk_desc_template(ctx);
+	if (mtk_cipher_sa_alloc(ctx))
+		return -ENOMEM;
 
 	ctx->fallback = crypto_alloc_sync_skcipher(crypto_tfm_alg_name(tfm), 0,
 				CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
@@ -718,7 +1762,7 @@ static void mtk_skcipher_cra_exit(struct crypto_tfm *tfm)
 {
 	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(tfm);
 
-	kfree(ctx->sa);
+	mtk_cipher_sa_free(ctx);
 
 	if (ctx->fallback)
 		crypto_free_sync_skcipher(ctx->fallback);
@@ -767,6 +1811,10 @@ static int mtk_skcipher_setkey(struct crypto_skcipher *ctfm, const u8 *key,
 	}
 
 	mtk_ctx_saRecord(ctx, key, nonce, keylen, flags);
+	if (IS_AES(flags))
+		mtk_ctx_aes_deckey(ctx, &aes, keylen, flags);
+	memzero_explicit(&aes, sizeof(aes));
+	mtk_sa_cache_flush(ctx);
 
 	if (ctx->fallback) {
 		ret = crypto_sync_skcipher_setkey(ctx->fallback, key, len);
@@ -785,10 +1833,6 @@ static int mtk_skcipher_crypt(struct skcipher_request *req)
 	struct mtk_cipher_ctx *ctx = crypto_tfm_ctx(req->base.tfm);
 	struct mtk_device *mtk = ctx->mtk;
 	int ret;
-	int DescriptorCountDone = MTK_RING_SIZE - 1;
-	int DescriptorDoneTimeout = 15;
-	int DescriptorPendingCount = 0;
-	int commands = 0, results = 0;
 	struct crypto_skcipher *skcipher = crypto_skcipher_reqtfm(req);
 	u32 ivsize = crypto_skcipher_ivsize(skcipher);
 
@@ -816,43 +1860,9 @@ static int mtk_skcipher_crypt(struct skcipher_request *req)
 		return ret;
 	}
 
-	if (mtk->ring[0].requests > MTK_RING_BUSY)
-		return -EAGAIN;
-
-	ret = mtk_send_req(base, ctx, req->src, req->dst, req->iv,
-				rctx, &commands, &results);
-
-	if (ret) {
-		base->complete(base, ret);
-		return ret;
-	}
-
-	if (commands == 0)
-		return 0;
-
-	spin_lock_bh(&mtk->ring[0].lock);
-	mtk->ring[0].requests += commands;
-
-	if (!mtk->ring[0].busy) {
-		DescriptorPendingCount = min_t(int, mtk->ring[0].requests, 32);
-		writel(BIT(31) | (DescriptorCountDone & GENMASK(10, 0)) |
-			(((DescriptorPendingCount - 1) & GENMASK(10, 0)) << 16) |
-			((DescriptorDoneTimeout  & GENMASK(4, 0)) << 26),
-			mtk->base + EIP93_REG_PE_RING_THRESH);
-		mtk->ring[0].busy = true;
-	}
+	rctx->cpu = raw_smp_processor_id();
 
-	if (mtk->ring[0].requests > MTK_RING_BUSY) {
-		ret = -EBUSY;
-		rctx->flags |= MTK_BUSY;
-	} else
-		ret = -EINPROGRESS;
-
-	spin_unlock_bh(&mtk->ring[0].lock);
-	/* Writing new descriptor count starts DMA action */
-	writel(commands, mtk->base + EIP93_REG_PE_CD_COUNT);
-
-	return ret;
+	return mtk_queue_req(mtk, base, rctx->assoclen + rctx->textsize);
 }
 
 static int mtk_skcipher_encrypt(struct skcipher_request *req)
@@ -892,16 +1902,18 @@ static int mtk_aead_cra_init(struct crypto_tfm *tfm)
 	memset(ctx, 0, sizeof(*ctx));
 
 	crypto_aead_set_reqsize(__crypto_aead_cast(tfm),
-			sizeof(struct mtk_cipher_reqctx));
+			offsetof(struct mtk_cipher_reqctx, stream));
 
 	ctx->mtk = tmpl->mtk;
 	ctx->aead = true;
+	ctx->base.send_req = mtk_aead_send_req;
 	ctx->base.handle_result = mtk_aead_handle_result;
 	ctx->fallback = NULL;
+	ctx->authsize = crypto_aead_authsize(__crypto_aead_cast(tfm));
+	mtk_desc_template(ctx);
 
-	ctx->sa = kzalloc(sizeof(struct saRecord_s), GFP_KERNEL);
-	if (!ctx->sa)
-		printk("!! no sa memory\n");
+	if (mtk_cipher_sa_alloc(ctx))
+		return -ENOMEM;
 
 	/* software workaround for now */
 	if (IS_HASH_MD5(flags))
@@ -931,7 +1943,7 @@ static void mtk_aead_cra_exit(struct crypto_tfm *tfm)
 	if (ctx->shash)
 		crypto_free_shash(ctx->shash);
 
-	kfree(ctx->sa);
+	mtk_cipher_sa_free(ctx);
 }
 
 static int mtk_aead_setkey(struct crypto_aead *ctfm, const u8 *key,
@@ -943,10 +1955,13 @@ static int mtk_aead_setkey(struct crypto_aead *ctfm, const u8 *key,
 				struct mtk_alg_template, alg.skcipher.base);
 	unsigned long int flags = tmpl->flags;
 	struct crypto_authenc_keys keys;
+	struct crypto_aes_ctx aes;
+	bool deckey;
 	int bs = crypto_shash_blocksize(ctx->shash);
 	int ds = crypto_shash_digestsize(ctx->shash);
 	u8 *ipad, *opad;
-	unsigned int i, err;
+	unsigned int i;
+	int err;
 	u32 nonce;
 
 	SHASH_DESC_ON_STACK(shash, ctx->shash);
@@ -965,14 +1980,21 @@ static int mtk_aead_setkey(struct crypto_aead *ctfm, const u8 *key,
 	if (keys.enckeylen > AES_MAX_KEY_SIZE)
 		goto badkey;
 
+	/* expanded only for the decrypt key, CTR never needs one */
+	deckey = IS_AES(flags) && !IS_CTR(flags);
+	if (deckey && aes_expandkey(&aes, keys.enckey, keys.enckeylen))
+		goto badkey;
+
 	/* auth key
 	 *
 	 * EIP93 can only authenticate with hash of the key
 	 * do software shash until EIP93 hash function complete.
 	 */
 	ipad = kcalloc(2, SHA512_BLOCK_SIZE, GFP_KERNEL);
- 	if (!ipad)
- 		return -ENOMEM;
+	if (!ipad) {
+		err = -ENOMEM;
+		goto free_aes;
+	}
 
 	opad = ipad + SHA512_BLOCK_SIZE;
 
@@ -982,7 +2004,7 @@ static int mtk_aead_setkey(struct crypto_aead *ctfm, const u8 *key,
 		err = crypto_shash_digest(shash, keys.authkey,
 					keys.authkeylen, ipad);
 		if (err)
-			return err;
+			goto free_pad;
 
 		keys.authkeylen = ds;
 	} else
@@ -1004,18 +2026,28 @@ static int mtk_aead_setkey(struct crypto_aead *ctfm, const u8 *key,
 				 crypto_shash_export(shash, opad);
 
 	if (err)
-		return err;
+		goto free_pad;
 
 	/* Encryption key */
 	mtk_ctx_saRecord(ctx, keys.enckey, nonce, keys.enckeylen, flags);
+	if (deckey)
+		mtk_ctx_aes_deckey(ctx, &aes, keys.enckeylen, flags);
 	/* add auth key */
 	memcpy(&ctx->sa->saIDigest, ipad, SHA256_DIGEST_SIZE);
 	memcpy(&ctx->sa->saODigest, opad, SHA256_DIGEST_SIZE);
+	mtk_sa_cache_flush(ctx);
 
+free_pad:
+	/* key material: the pads, the hash state and the round keys */
+	shash_desc_zero(shash);
+	memzero_explicit(ipad, 2 * SHA512_BLOCK_SIZE);
 	kfree(ipad);
+free_aes:
+	memzero_explicit(&aes, sizeof(aes));
 	return err;
 
 badkey:
+	memzero_explicit(&aes, sizeof(aes));
 	crypto_aead_set_flags(ctfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
 	return -EINVAL;
 }
@@ -1043,10 +2075,6 @@ static int mtk_aead_crypt(struct aead_request *req)
 	u32 authsize = crypto_aead_authsize(aead);
 	u32 ivsize = crypto_aead_ivsize(aead);
 	int ret;
-	int DescriptorCountDone = MTK_RING_SIZE - 1;
-	int DescriptorDoneTimeout = 15;
-	int DescriptorPendingCount = 0;
-	int commands = 0, results = 0;
 
 	rctx->textsize = req->cryptlen;
 	rctx->assoclen = req->assoclen;
@@ -1059,43 +2087,9 @@ static int mtk_aead_crypt(struct aead_request *req)
 	if (!rctx->textsize)
 		return 0;
 
-	if (mtk->ring[0].requests > MTK_RING_BUSY)
-		return -EAGAIN;
-
-	ret = mtk_send_req(base, ctx, req->src, req->dst, req->iv,
-				rctx, &commands, &results);
-
-	if (ret) {
-		base->complete(base, ret);
-		return ret;
-	}
-
-	if (commands == 0)
-		return 0;
-
-	spin_lock_bh(&mtk->ring[0].lock);
-	mtk->ring[0].requests += commands;
-
-	if (!mtk->ring[0].busy) {
-		DescriptorPendingCount = mtk->ring[0].requests;
-		writel(BIT(31) | (DescriptorCountDone & GENMASK(10, 0)) |
-			(((DescriptorPendingCount - 1) & GENMASK(10, 0)) << 16) |
-			((DescriptorDoneTimeout  & GENMASK(4, 0)) << 26),
-			mtk->base + EIP93_REG_PE_RING_THRESH);
-		mtk->ring[0].busy = true;
-	}
-	if (mtk->ring[0].requests > MTK_RING_BUSY) {
-		ret = -EBUSY;
-		rctx->flags |= MTK_BUSY;
-	} else
-		ret = -EINPROGRESS;
-
-	spin_unlock_bh(&mtk->ring[0].lock);
+	rctx->cpu = raw_smp_processor_id();
 
-	/* Writing new descriptor count starts DMA action */
-	writel(commands, mtk->base + EIP93_REG_PE_CD_COUNT);
-
-	return ret;
+	return mtk_queue_req(mtk, base, rctx->assoclen + rctx->textsize);
 }
 
 static int mtk_aead_encrypt(struct aead_request *req)
@@ -41,10 +41,79 @@ extern struct mtk_alg_template mtk_alg_authenc_hmac_sha224_ecb_null;
 extern struct mtk_alg_template mtk_alg_authenc_hmac_sha256_ecb_null;
 extern struct mtk_alg_template mtk_alg_echainiv_authenc_hmac_sha256_cbc_aes;
 
+/**
+ * struct mtk_sa_variant - prepared SA record in mtk->sa_pool
+ * @key: MTK_SA_KEY() it was built for, 0 while the entry is free
+ */
+struct mtk_sa_variant {
+	u32			key;
+	struct saRecord_s	*sa;
+	dma_addr_t		sa_base;
+};
+
+/**
+ * struct mtk_plan_piece - one descriptor of a partial bounce plan
+ * @pos: offset in the request
+ * @boff: offset in the bounce buffer, -1 when taken from @src/@dst
+ * @soff: offset of @pos in the caller's @src segment, @doff likewise
+ */
+struct mtk_plan_piece {
+	struct scatterlist	*src;
+	struct scatterlist	*dst;
+	u32			soff;
+	u32			doff;
+	u32			pos;
+	u32			len;
+	int			boff;
+};
+
+struct mtk_plan {
+	struct mtk_plan_piece	piece[MTK_PLAN_PIECES];
+	int			npieces;
+	u32			bounced;
+	bool			held;
+};
+
+/**
+ * struct mtk_stream - skcipher request sent in windows, see mtk_stream_fill()
+ * @desc: descriptor template of all windows, userId set per window
+ * @len: bytes in the request, 0 when it is not streamed
+ * @sent: bytes handed to the engine, in @nsent windows
+ * @ndone: windows retired; window n uses slot n % MTK_STREAM_DEPTH below
+ * @err: first error; no window is sent after it
+ */
+struct mtk_stream {
+	struct crypto_async_request	*req;
+	struct scatterlist	*src;
+	struct scatterlist	*dst;
+	struct eip93_descriptor_s	desc;
+	spinlock_t		lock;
+	u32			len;
+	u32			sent;
+	u32			nsent;
+	u32			ndone;
+	int			err;
+	/* per window: clamped views of src and dst, and the entries mapped */
+	struct scatterlist	view_src[MTK_STREAM_DEPTH][MTK_STREAM_SEGS];
+	struct scatterlist	view_dst[MTK_STREAM_DEPTH][MTK_STREAM_SEGS];
+	struct scatterlist	*win_src[MTK_STREAM_DEPTH];
+	struct scatterlist	*win_dst[MTK_STREAM_DEPTH];
+	int			nents_src[MTK_STREAM_DEPTH];
+	int			nents_dst[MTK_STREAM_DEPTH];
+};
+
 struct mtk_cipher_ctx {
 	struct mtk_context		base;
 	struct mtk_device		*mtk;
+	/* SA built by setkey, the variants below are derived from it */
 	struct saRecord_s		*sa;
+	struct mtk_sa_variant		sa_cache[MTK_SA_CACHE_SIZE];
+	spinlock_t			sa_lock;
+	/* descriptor template: request fields are filled in on a copy */
+	struct eip93_descriptor_s	desc;
+	/* AES ECB/CBC: last round keys, loaded by the decrypt variants */
+	u8				dec_key[AES_MAX_KEY_SIZE];
+	unsigned int			dec_keylen;
 	struct crypto_sync_skcipher	*fallback;
 
 	/* AEAD specific */
@@ -60,13 +129,52 @@ struct mtk_cipher_reqctx {
 	/* AEAD */
 	u32                     assoclen;
 	u32			authsize;
+	/* own SA record when the tfm's variant cache is full */
+	struct saRecord_s	*sa;
+	dma_addr_t		sa_base;
+	/* same, for the AEAD descriptors after the first */
+	struct saRecord_s	*sa_cont;
+	dma_addr_t		sa_cont_base;
+	/* saState pool indices, the second one for a CTR overflow; -1 none */
+	int			state[2];
 	/* copy in case of mis-alignment or AEAD if no-consecutive blocks */
 	struct scatterlist	*sg_src;
 	struct scatterlist	*sg_dst;
+	/* pool buffers behind sg_src/sg_dst, index 0 src and 1 dst */
+	struct mtk_bounce	bounce[2];
+	struct scatterlist	bounce_sg[2];
+	/* partial bounce, its stitched pieces live in bounce[0] */
+	struct mtk_plan		plan;
+	struct scatterlist	plan_src[MTK_PLAN_PIECES];
+	struct scatterlist	plan_dst[MTK_PLAN_PIECES];
 	int			src_nents;
 	int			dst_nents;
+	/* CPU the request was issued on, its callback is steered there */
+	int			cpu;
+	/* status for the callback while it waits in a steering queue */
+	int			err;
 	/* AES-CTR in case of counter overflow */
 	struct scatterlist	ctr_src[2];
 	struct scatterlist	ctr_dst[2];
+	/*
+	 * large skcipher requests; stays last, AEAD requests never stream
+	 * and are allocated without it, see mtk_aead_cra_init()
+	 */
+	struct mtk_stream	stream;
 };
+
+int mtk_stream_resume(struct mtk_device *mtk,
+			struct crypto_async_request *async);
+
+struct mtk_cipher_reqctx *mtk_async_reqctx(struct crypto_async_request *async);
+
+#ifdef CONFIG_CRYPTO_MANAGER_EXTRA_TESTS
+int mtk_aead_selftest(void);
+#else
+static inline int mtk_aead_selftest(void)
+{
+	return 0;
+}
+#endif
+
 #endif /* _CIPHER_H_ */
@@ -50,7 +50,6 @@
 #define MTK_DECRYPT			BIT(13)
 
 #define MTK_GENIV			BIT(14)
-#define MTK_BUSY			BIT(15)
 
 #define IS_DES(flags)			(flags & MTK_ALG_DES)
 #define IS_3DES(flags)			(flags & MTK_ALG_3DES)
@@ -68,8 +67,6 @@
 #define IS_RFC3686(mode)		(mode & MTK_MODE_RFC3686)
 #define IS_GENIV(flags)			(flags & MTK_GENIV)
 
-#define IS_BUSY(flags)			(flags & MTK_BUSY)
-
 #define IS_ENCRYPT(dir)			(dir & MTK_ENCRYPT)
 #define IS_DECRYPT(dir)			(dir & MTK_DECRYPT)
 
@@ -87,10 +84,54 @@
 #define CRYPTO_ENCRYPTION		1
 #define CRYPTO_DECRYPTION		2
 
+/* default ring depth, overridden by DT "mediatek,ring-size" or ring_size */
 #define MTK_RING_SIZE			256
-#define MTK_RING_BUSY			224
+#define MTK_RING_MIN_SIZE		32
+/* queue new requests in software above 7/8 of the ring */
+#define MTK_RING_BUSY(size)		((size) - (size) / 8)
 #define NUM_AES_BYPASS			0
+/* software queue depth before requests go to the backlog */
 #define MTK_QUEUE_LENGTH		128
+/* bounce buffer size classes, see mtk_bounce_classes */
+#define MTK_BOUNCE_CLASSES		3
+/*
+ * Partial bounce plans: at most MTK_PLAN_PIECES descriptors; one more
+ * descriptor is taken to cost as much as copying MTK_PLAN_DESC_COST bytes.
+ */
+#define MTK_PLAN_PIECES			8
+#define MTK_PLAN_DESC_COST		256
+/*
+ * skcipher requests of at least MTK_STREAM_MIN bytes are mapped and sent
+ * in windows of MTK_STREAM_WINDOW bytes, MTK_STREAM_DEPTH of them in flight.
+ */
+#define MTK_STREAM_MIN			BIT(19)
+#define MTK_STREAM_WINDOW		BIT(17)
+#define MTK_STREAM_DEPTH		2
+/* sg entries of one side of a window, a window ends early past them */
+#define MTK_STREAM_SEGS			16
+/* default doorbell batch, see batch_max; batch_us 0 rings every time */
+#define MTK_BATCH_MAX			16
+/* default result descriptors per poll, see poll_budget */
+#define MTK_POLL_BUDGET			64
+/* default request size polled on an idle ring, see poll_max */
+#define MTK_POLL_MAX			64
+#define MTK_POLL_TIMEOUT_US		50
+
+/*
+ * SA variant key: direction, whether the request spans more than one
+ * descriptor (state has to be carried over), authsize and assoclen.
+ */
+#define MTK_SA_CACHE_SIZE		8
+#define MTK_SA_VALID			BIT(0)
+#define MTK_SA_DECRYPT			BIT(1)
+#define MTK_SA_CHAIN			BIT(2)
+/* AEAD descriptors after the first: hash continues from saState */
+#define MTK_SA_CONT			BIT(3)
+#define MTK_SA_KEY(flags, authsize, assoclen)	((flags) | MTK_SA_VALID | \
+					(((authsize) & GENMASK(7, 0)) << 8) | \
+					(((assoclen) & GENMASK(15, 0)) << 16))
+#define MTK_SA_AUTHSIZE(key)		(((key) >> 8) & GENMASK(7, 0))
+#define MTK_SA_ASSOCLEN(key)		((key) >> 16)
 #define MTK_CRA_PRIORITY		1500
 
 
@@ -100,8 +141,29 @@
 #define MTK_DESC_AHASH			BIT(3)
 #define MTK_DESC_PRNG			BIT(4)
 #define MTK_DESC_FAKE_HMAC		BIT(5)
-#define MTK_DESC_LAST			BIT(6)
-#define MTK_DESC_FINISH			BIT(7)
+#define MTK_DESC_READY			BIT(8)
+#define MTK_DESC_NULL			BIT(9)
+
+/* peLength.length is 20 bits wide */
+#define MTK_DESC_MAX_LEN		GENMASK(19, 0)
+/*
+ * Longest descriptor built for a request; longer runs are cut into chained
+ * descriptors. A multiple of every cipher and hash block, well within the
+ * 20-bit length field. All descriptors of a request are reserved together,
+ * so this does not let other requests in between; only streaming does.
+ */
+#define MTK_DESC_CHUNK			BIT(16)
+
+/*
+ * Descriptor userId cookie, echoed in the result descriptor:
+ * [9:0] first ring slot of the request, [19:10] its descriptor count,
+ * [31:20] sequence number.
+ */
+#define MTK_COOKIE(idx, n, seq)		(((idx) & GENMASK(9, 0)) | \
+					(((n) & GENMASK(9, 0)) << 10) | \
+					(((seq) & GENMASK(11, 0)) << 20))
+#define MTK_COOKIE_IDX(cookie)		((cookie) & GENMASK(9, 0))
+#define MTK_COOKIE_NDESC(cookie)	(((cookie) >> 10) & GENMASK(9, 0))
 
 /*
  * Interrupts of EIP93
@@ -184,6 +246,9 @@ typedef struct saState_s {
 	unsigned int	stateIDigest[8];
 } saState_t;
 
+/* saState records are handed out one cache line each */
+#define MTK_STATE_STRIDE	ALIGN(sizeof(struct saState_s), L1_CACHE_BYTES)
+
 typedef union {
 	struct {
 		unsigned int hostReady		:1;
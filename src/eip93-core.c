@@ -5,14 +5,27 @@
  * Richard van Schagen <vschagen@cs.com>
  */
 //#define DEBUG 1
+#include <linux/cache.h>
 #include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmapool.h>
+#include <linux/cpumask.h>
 #include <linux/interrupt.h>
+#include <linux/irq_work.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
 #include <linux/spinlock.h>
+#include <linux/string.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 #include <crypto/internal/aead.h>
 #include <crypto/internal/skcipher.h>
@@ -25,6 +38,34 @@
 #include "eip93-cipher.h"
 #include "eip93-prng.h"
 
+static unsigned int ring_size;
+module_param(ring_size, uint, 0444);
+MODULE_PARM_DESC(ring_size,
+	"Descriptors per ring, 32 - 1023 (default: DT mediatek,ring-size or 256)");
+
+static bool cached_rings;
+module_param(cached_rings, bool, 0444);
+MODULE_PARM_DESC(cached_rings,
+	"Descriptor rings in cached memory, synced per batch (default: off)");
+
+static unsigned int poll_max = MTK_POLL_MAX;
+module_param(poll_max, uint, 0644);
+MODULE_PARM_DESC(poll_max,
+	"Largest request in bytes polled on an idle ring, 0 disables (default: 64)");
+
+static unsigned int poll_budget = MTK_POLL_BUDGET;
+module_param(poll_budget, uint, 0644);
+MODULE_PARM_DESC(poll_budget,
+	"Result descriptors retired per poll before yielding (default: 64)");
+
+static bool steer = true;
+module_param(steer, bool, 0644);
+MODULE_PARM_DESC(steer,
+	"Run completion callbacks on the submitting CPU (default: on)");
+
+/* set while one of our callbacks runs, see mtk_queue_req() */
+static DEFINE_PER_CPU(bool, mtk_in_callback);
+
 static struct mtk_alg_template *mtk_algs[] = {
 	&mtk_alg_ecb_des,
 	&mtk_alg_cbc_des,
@@ -100,7 +141,13 @@ static void mtk_unregister_algs(struct mtk_device *mtk, int i)
 
 static int mtk_register_algs(struct mtk_device *mtk)
 {
-	int i, ret = 0;
+	int i, ret;
+
+	ret = mtk_aead_selftest();
+	if (ret) {
+		dev_err(mtk->dev, "AEAD self-test failed\n");
+		return ret;
+	}
 
 	for (i = 0; i < ARRAY_SIZE(mtk_algs); i++) {
 		mtk_algs[i]->mtk = mtk;
@@ -156,110 +203,532 @@ static inline void mtk_irq_clear(struct mtk_device *mtk, u32 mask)
 	__raw_readl(mtk->base + EIP93_REG_INT_CLR);
 }
 
-inline void mtk_push_request(struct mtk_device *mtk, int DescriptorPendingCount)
+/* run a completion round in the current mode */
+static void mtk_done_kick(struct mtk_device *mtk)
 {
-	int DescriptorCountDone = MTK_RING_SIZE - 1;
-	int DescriptorDoneTimeout = 15;
+	struct mtk_ring *ring = &mtk->ring[0];
+
+	switch (READ_ONCE(ring->done_mode)) {
+	case MTK_DONE_THREAD:
+		irq_wake_thread(mtk->irq, mtk);
+		break;
+	case MTK_DONE_WORK:
+		queue_work(ring->workdone, &ring->work_done.work);
+		break;
+	default:
+		tasklet_schedule(&mtk->tasklet);
+	}
+}
 
-	DescriptorPendingCount = min_t(int, mtk->ring[0].requests, 8);
+/* run @req's callback the way the crypto API expects it, with BH off */
+static void mtk_callback(struct crypto_async_request *req, int err)
+{
+	bool nested;
+
+	local_bh_disable();
+	nested = __this_cpu_read(mtk_in_callback);
+	__this_cpu_write(mtk_in_callback, true);
+	req->complete(req, err);
+	__this_cpu_write(mtk_in_callback, nested);
+	local_bh_enable();
+}
 
-	if (!DescriptorPendingCount)
-		return;
+/*
+ * Run the callbacks queued on @st in order. One context at a time does
+ * so, or a later request could overtake one still being completed; a
+ * context that finds @st busy leaves its entries to the holder, which
+ * looks again before it lets go.
+ */
+static void mtk_steer_drain(struct mtk_steer *st)
+{
+	struct crypto_async_request *req, *tmp;
+	LIST_HEAD(todo);
 
-	writel(BIT(31) | (DescriptorCountDone & GENMASK(10, 0)) |
-		(((DescriptorPendingCount - 1) & GENMASK(10, 0)) << 16) |
-		((DescriptorDoneTimeout  & GENMASK(4, 0)) << 26),
-		mtk->base + EIP93_REG_PE_RING_THRESH);
+	while (!test_and_set_bit_lock(0, &st->busy)) {
+		spin_lock_bh(&st->lock);
+		list_splice_init(&st->list, &todo);
+		spin_unlock_bh(&st->lock);
+
+		list_for_each_entry_safe(req, tmp, &todo, list)
+			mtk_callback(req, mtk_async_reqctx(req)->err);
+		INIT_LIST_HEAD(&todo);
+
+		clear_bit_unlock(0, &st->busy);
+		smp_mb__after_atomic();
+		if (list_empty_careful(&st->list))
+			break;
+	}
 }
 
-static void mtk_handle_result_descriptor(struct mtk_device *mtk)
+/*
+ * Complete @req with @err on the CPU that submitted it, so the caller
+ * picks up the result where its data is cache hot. The request is queued
+ * for that CPU, or for this one with steering off, and the CPU is added
+ * to @kick for mtk_steer_kick(); all of a CPU's callbacks go through its
+ * queue, so they run in the order they were queued.
+ */
+static void mtk_complete(struct mtk_device *mtk,
+			struct crypto_async_request *req, int err,
+			struct cpumask *kick)
 {
-	struct crypto_async_request *req = NULL;
+	struct mtk_cipher_reqctx *rctx = mtk_async_reqctx(req);
+	struct mtk_steer *st;
+	u32 cpu = rctx->cpu;
+
+	if (!READ_ONCE(steer) || cpu >= nr_cpu_ids)
+		cpu = raw_smp_processor_id();
+
+	rctx->err = err;
+	st = per_cpu_ptr(mtk->steer, cpu);
+
+	spin_lock_bh(&st->lock);
+	list_add_tail(&req->list, &st->list);
+	spin_unlock_bh(&st->lock);
+
+	cpumask_set_cpu(cpu, kick);
+}
+
+/*
+ * Feed queued requests to the ring until it fills up. A request that does
+ * not fit is parked in ring->req and retried first on the next call, so
+ * the queue order is kept; the rest of streamed requests goes before it.
+ */
+static void mtk_feed(struct mtk_device *mtk, struct cpumask *kick)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct crypto_async_request *req, *backlog;
 	struct mtk_context *ctx;
-	struct mtk_desc_buf *buf;
-	struct eip93_descriptor_s *cdesc;
+	int ret;
+
+	/*
+	 * streams already under way go first, in order; one is off the list
+	 * while it is resumed, as a window it sends may park it again
+	 */
+	while (true) {
+		spin_lock_bh(&ring->queue_lock);
+		req = list_first_entry_or_null(&ring->streams,
+				struct crypto_async_request, list);
+		if (req)
+			list_del(&req->list);
+		spin_unlock_bh(&ring->queue_lock);
+
+		if (!req)
+			break;
+
+		ret = mtk_stream_resume(mtk, req);
+		if (ret == -EAGAIN) {
+			/* nothing in flight for it: back to the front */
+			spin_lock_bh(&ring->queue_lock);
+			list_add(&req->list, &ring->streams);
+			spin_unlock_bh(&ring->queue_lock);
+			return;
+		}
+
+		if (ret != -EINPROGRESS)
+			mtk_complete(mtk, req, ret, kick);
+	}
+
+	req = ring->req;
+	backlog = ring->backlog;
+	if (req)
+		goto handle_req;
+
+	while (true) {
+		spin_lock_bh(&ring->queue_lock);
+		backlog = crypto_get_backlog(&ring->queue);
+		req = crypto_dequeue_request(&ring->queue);
+		spin_unlock_bh(&ring->queue_lock);
+
+		if (!req)
+			break;
+handle_req:
+		ctx = crypto_tfm_ctx(req->tfm);
+		ret = ctx->send_req(req);
+		if (ret == -EAGAIN)
+			goto request_failed;
+
+		if (backlog)
+			mtk_callback(backlog, -EINPROGRESS);
+
+		if (ret != -EINPROGRESS)
+			mtk_complete(mtk, req, ret, kick);
+	}
+
+	WRITE_ONCE(ring->req, NULL);
+	ring->backlog = NULL;
+
+	return;
+
+request_failed:
+	/* not enough ring space: retry once results free some */
+	WRITE_ONCE(ring->req, req);
+	ring->backlog = backlog;
+}
+
+/*
+ * Feed the ring from a completion round, outside done_lock. One context
+ * feeds at a time; a round that finds it taken asks the holder to go
+ * again, so space freed by its results is not left unused.
+ */
+static void mtk_dequeue(struct mtk_device *mtk, struct cpumask *kick)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+
+	set_bit(MTK_RING_REFEED, &ring->state);
+
+	while (!test_and_set_bit_lock(MTK_RING_FEED, &ring->state)) {
+		clear_bit(MTK_RING_REFEED, &ring->state);
+		smp_mb__after_atomic();
+		mtk_feed(mtk, kick);
+
+		clear_bit_unlock(MTK_RING_FEED, &ring->state);
+		smp_mb__after_atomic();
+		if (!test_bit(MTK_RING_REFEED, &ring->state))
+			break;
+	}
+}
+
+/*
+ * Status of the @n result descriptors of the request at slot @idx. Each
+ * has to echo the request's cookie; anything else is a lost or duplicated
+ * result and fails the request.
+ */
+static int mtk_result_status(struct mtk_device *mtk, u32 idx, u32 n)
+{
 	struct eip93_descriptor_s *rdesc;
-	int ret, ndesc, rptr;
-	int nreq = 0;
-	int handled = 0;
-	u32 err = 0, idx;
-	bool should_complete;
+	u32 cookie = mtk->ring[0].dma_buf[idx].cookie;
+	int err = 0;
 
-handle_results:
-	nreq = readl(mtk->base + EIP93_REG_PE_RD_COUNT) & GENMASK(10, 0);
+	while (n--) {
+		rdesc = mtk_ring_rdesc(mtk, idx);
 
-	if (!nreq)
-		goto requests_left;
+		if (rdesc->userId != cookie) {
+			dev_err_ratelimited(mtk->dev,
+				"slot %u: result %08x, expected %08x\n",
+				idx, rdesc->userId, cookie);
+			return -EIO;
+		}
 
-	rptr =  mtk_ring_first_cdr_index(mtk);
-	buf = &mtk->ring[0].dma_buf[rptr];
-	if (buf->flags & MTK_DESC_PRNG) {
-		cdesc = mtk_ring_next_rptr(mtk, &mtk->ring[0].cdr, &idx);
-		rdesc = mtk_ring_next_rptr(mtk, &mtk->ring[0].rdr, &idx);
-		buf->flags = 0;
-		mtk_prng_done(mtk, err);
-		handled++;
-		goto acknowledge;
+		if (rdesc->peCrtlStat.bits.errStatus) {
+			dev_err(mtk->dev, "Err: %02x\n",
+					rdesc->peCrtlStat.bits.errStatus);
+			err = -EINVAL;
+		}
+
+		idx = mtk_ring_next_index(mtk, idx);
 	}
 
-	if (buf->flags & MTK_DESC_ASYNC)
-		req = (struct crypto_async_request *)buf->req;
-	else
-		goto acknowledge;
+	return err;
+}
 
-	ctx = crypto_tfm_ctx(req->tfm);
-	ndesc = ctx->handle_result(mtk, req, &should_complete, &ret);
+/*
+ * Spin on the result of the polled request instead of waiting for the
+ * interrupt and a completion round, then finish it here. Rounds leave the
+ * request alone until it is done and then only retire its slots; the RDR
+ * interrupt stays masked meanwhile, see mtk_done_unmask(). Past
+ * MTK_POLL_TIMEOUT_US the request is handed back to the rounds and
+ * completes through its callback as usual.
+ */
+static int mtk_poll_wait(struct mtk_device *mtk,
+				struct crypto_async_request *req)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_context *ctx = crypto_tfm_ctx(req->tfm);
+	struct eip93_descriptor_s *rdesc;
+	u32 cookie = ring->poll_cookie;
+	u32 idx = MTK_COOKIE_IDX(cookie);
+	u32 n = MTK_COOKIE_NDESC(cookie);
+	u32 last = (idx + n - 1) % ring->size;
+	int i, ret;
+
+	rdesc = mtk_ring_rdesc(mtk, last);
+	/* the kick below has a round unmask it again */
+	mtk_irq_disable(mtk, BIT(1));
+
+	for (i = 0; i < MTK_POLL_TIMEOUT_US; i++) {
+		mtk_ring_sync_results(mtk, last, 1);
+		if (READ_ONCE(rdesc->userId) == cookie &&
+				rdesc->peCrtlStat.bits.peReady &&
+				rdesc->peLength.bits.peReady)
+			break;
+		udelay(1);
+	}
 
-	if (ndesc < 0) {
-		dev_err(mtk->dev, "failed get result\n");
-		goto acknowledge;
+	if (i == MTK_POLL_TIMEOUT_US) {
+		smp_store_release(&ring->poll_state, MTK_POLL_ASYNC);
+		mtk_done_kick(mtk);
+		return -EINPROGRESS;
 	}
 
-	if (should_complete) {
-		local_bh_disable();
-		req->complete(req, ret);
-		local_bh_enable();
+	smp_store_release(&ring->poll_state, MTK_POLL_BUSY);
+	dma_rmb();
+	mtk_ring_sync_results(mtk, idx, n);
+
+	ret = mtk_result_status(mtk, idx, n);
+	ret = ctx->handle_result(mtk, req, ring->dma_buf[last].saPointer, ret);
+
+	/* the slots still have to be retired */
+	smp_store_release(&ring->poll_state, MTK_POLL_DONE);
+	mtk_done_kick(mtk);
+
+	return ret;
+}
+
+/*
+ * Submit @req, going through the software queue when the ring is short of
+ * space or other requests are already waiting. A request of at most
+ * poll_max bytes (@len) that finds the ring idle and may sleep is polled
+ * to completion; one from softirq or with BH off never spins.
+ * Returns 0 or an error when polled, otherwise -EINPROGRESS, -EBUSY when
+ * the request went to the backlog, or an error.
+ */
+int mtk_queue_req(struct mtk_device *mtk, struct crypto_async_request *req,
+			u32 len)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_context *ctx = crypto_tfm_ctx(req->tfm);
+	int ret;
+
+	if (!READ_ONCE(ring->req) && !READ_ONCE(ring->queue.qlen) &&
+		atomic_read(&ring->requests) <= ring->busy_watermark) {
+		/* not from a callback, which runs with BH off */
+		if (len <= READ_ONCE(poll_max) &&
+			(req->flags & CRYPTO_TFM_REQ_MAY_SLEEP) &&
+			!this_cpu_read(mtk_in_callback) &&
+			!atomic_read(&ring->requests) &&
+			!test_and_set_bit_lock(MTK_RING_POLL, &ring->state)) {
+			ring->poll_req = req;
+			ring->poll_state = MTK_POLL_WAIT;
+
+			ret = ctx->send_req(req);
+			if (ret == -EINPROGRESS) {
+				/* nothing to batch with while spinning */
+				mtk_ring_flush(mtk);
+				return mtk_poll_wait(mtk, req);
+			}
+
+			ring->poll_req = NULL;
+			clear_bit_unlock(MTK_RING_POLL, &ring->state);
+		} else
+			ret = ctx->send_req(req);
+
+		if (ret != -EAGAIN)
+			return ret;
 	}
 
-	handled += ndesc;
+	spin_lock_bh(&ring->queue_lock);
+	ret = crypto_enqueue_request(&ring->queue, req);
+	spin_unlock_bh(&ring->queue_lock);
 
-acknowledge:
-	if (handled) {
-		writel(handled, mtk->base + EIP93_REG_PE_RD_COUNT);
+	/* the ring may have drained meanwhile: let a round dequeue */
+	mtk_done_kick(mtk);
+
+	return ret;
+}
+
+/*
+ * One IPI per other CPU that got completions; ours, and those of a CPU
+ * that is gone, run here. With preemption off no CPU can go down between
+ * the check and the IPI: a CPU that goes down later still runs its
+ * pending irq_work, and its tasklet moves to a live CPU.
+ */
+static void mtk_steer_kick(struct mtk_device *mtk, struct cpumask *kick)
+{
+	struct mtk_steer *st;
+	int cpu, self;
 
-		spin_lock_bh(&mtk->ring[0].lock);
-		mtk->ring[0].requests -= handled;
+	for_each_cpu(cpu, kick) {
+		st = per_cpu_ptr(mtk->steer, cpu);
 
-		if (!mtk->ring[0].requests) {
-			mtk->ring[0].busy = false;
-			spin_unlock_bh(&mtk->ring[0].lock);
-			goto request_done;
+		self = get_cpu();
+		if (cpu != self && cpu_online(cpu)) {
+			irq_work_queue_on(&st->work, cpu);
+			put_cpu();
+			continue;
 		}
-		spin_unlock_bh(&mtk->ring[0].lock);
-		handled = 0;
-		goto handle_results;
+		put_cpu();
+
+		mtk_steer_drain(st);
 	}
+}
+
+/* hard IRQ context on the target CPU: callbacks expect softirq */
+static void mtk_steer_irq_work(struct irq_work *work)
+{
+	struct mtk_steer *st = container_of(work, struct mtk_steer, work);
+
+	tasklet_schedule(&st->tasklet);
+}
 
-requests_left:
-	spin_lock_bh(&mtk->ring[0].lock);
-	if (mtk->ring[0].requests) {
-		ret = mtk->ring[0].requests;
-		mtk_push_request(mtk, mtk->ring[0].requests);
-	} else {
-		mtk->ring[0].busy = false;
-		ret = 0;
+static void mtk_steer_tasklet(unsigned long data)
+{
+	mtk_steer_drain((struct mtk_steer *)data);
+}
+
+static int mtk_steer_init(struct mtk_device *mtk)
+{
+	struct mtk_steer *st;
+	int cpu;
+
+	mtk->steer = alloc_percpu(struct mtk_steer);
+	if (!mtk->steer)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(mtk->steer, cpu);
+		init_irq_work(&st->work, mtk_steer_irq_work);
+		tasklet_init(&st->tasklet, mtk_steer_tasklet, (unsigned long)st);
+		spin_lock_init(&st->lock);
+		INIT_LIST_HEAD(&st->list);
+		st->busy = 0;
 	}
 
-	spin_unlock_bh(&mtk->ring[0].lock);
-request_done:
-	mtk_irq_enable(mtk, BIT(1));
+	return 0;
+}
 
-	return;
+/* after the interrupt is off: the last round may still have kicked */
+static void mtk_steer_free(struct mtk_device *mtk)
+{
+	struct mtk_steer *st;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(mtk->steer, cpu);
+		irq_work_sync(&st->work);
+		tasklet_kill(&st->tasklet);
+	}
+	free_percpu(mtk->steer);
+}
+
+/*
+ * Retire finished requests, at most @budget descriptors' worth, from one
+ * read of RD_COUNT and acknowledge them with one write. The cookie on the
+ * oldest slot gives the request's extent, so it is retired whole once its
+ * last descriptor is done; requests to complete go on @finished, with
+ * their status in the request context. Returns true when the budget ran
+ * out with results still waiting, or a counted result was not written
+ * back yet: the RDR interrupt then stays masked and the caller polls
+ * again. *@done is set to the descriptors retired.
+ */
+static bool mtk_handle_result_descriptor(struct mtk_device *mtk, u32 budget,
+					u32 *done, struct list_head *finished)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct crypto_async_request *req;
+	struct eip93_descriptor_s *rdesc;
+	struct mtk_context *ctx;
+	struct mtk_desc_buf *buf;
+	int ret, err;
+	u32 nreq, rptr, last, ndesc, flags, state;
+	u32 handled = 0;
+	bool more = false;
+	bool notify, poll;
+
+	*done = 0;
+	nreq = readl(mtk->base + EIP93_REG_PE_RD_COUNT) & GENMASK(10, 0);
+	/* counted descriptors are complete in memory */
+	dma_rmb();
+	mtk_ring_sync_results(mtk, mtk_ring_first_cdr_index(mtk), nreq);
+
+	while (handled < nreq) {
+		if (handled >= budget) {
+			more = true;
+			break;
+		}
+
+		rptr = mtk_ring_first_cdr_index(mtk);
+		buf = &ring->dma_buf[rptr];
+		ndesc = MTK_COOKIE_NDESC(buf->cookie);
+
+		/* the rest of the request is still in the engine */
+		if (!ndesc || ndesc > nreq - handled)
+			break;
+
+		last = (rptr + ndesc - 1) % ring->size;
+		rdesc = mtk_ring_rdesc(mtk, last);
+
+		/*
+		 * counted but not written back yet: no further interrupt is
+		 * due for it, so have the caller run another round
+		 */
+		if (!rdesc->peCrtlStat.bits.peReady ||
+				!rdesc->peLength.bits.peReady) {
+			more = true;
+			break;
+		}
+
+		flags = buf->flags;
+		req = (struct crypto_async_request *)buf->req;
+		notify = flags & MTK_DESC_ASYNC;
+		poll = notify && req == ring->poll_req;
+
+		if (poll) {
+			state = smp_load_acquire(&ring->poll_state);
+			/* the submitter is still spinning on it */
+			if (state == MTK_POLL_WAIT || state == MTK_POLL_BUSY)
+				break;
+			/* already finished by the submitter */
+			if (state == MTK_POLL_DONE)
+				notify = false;
+		}
+
+		err = mtk_result_status(mtk, rptr, ndesc);
+		ret = err;
+
+		if (flags & MTK_DESC_PRNG)
+			mtk_prng_done(mtk, err);
+		else if (notify) {
+			ctx = crypto_tfm_ctx(req->tfm);
+			ret = ctx->handle_result(mtk, req,
+					ring->dma_buf[last].saPointer, err);
+		}
+
+		if (poll) {
+			ring->poll_req = NULL;
+			clear_bit_unlock(MTK_RING_POLL, &ring->state);
+		}
+
+		buf->flags = 0;
+		buf->cookie = 0;
+
+		/* slots are free again once the result has been consumed */
+		mtk_ring_next_rptr(mtk, ndesc);
+		handled += ndesc;
+
+		/* -EINPROGRESS: more of the request is still to come */
+		if (notify && ret != -EINPROGRESS) {
+			mtk_async_reqctx(req)->err = ret;
+			list_add_tail(&req->list, finished);
+		}
+	}
+
+	*done = handled;
+
+	if (handled) {
+		writel(handled, mtk->base + EIP93_REG_PE_RD_COUNT);
+
+		if (!atomic_sub_return(handled, &ring->requests)) {
+			mtk_ring_idle(mtk);
+			return false;
+		}
+	}
+
+	if (more)
+		return true;
+
+	ret = atomic_read(&ring->requests);
+	if (ret)
+		mtk_push_request(mtk, ret);
+	else
+		mtk_ring_idle(mtk);
+
+	return false;
 }
 
 static irqreturn_t mtk_irq_handler(int irq, void *dev_id)
 {
 	struct mtk_device *mtk = (struct mtk_device *)dev_id;
+	struct mtk_ring *ring = &mtk->ring[0];
 	u32 irq_status;
 
 	irq_status = readl(mtk->base + EIP93_REG_INT_MASK_STAT);
@@ -267,26 +736,143 @@ static irqreturn_t mtk_irq_handler(int irq, void *dev_id)
 	if (irq_status & BIT(1)) {
 		mtk_irq_clear(mtk, BIT(1));
 		mtk_irq_disable(mtk, BIT(1));
-		tasklet_schedule(&mtk->tasklet);
-//		queue_work(mtk->ring[0].workdone, &mtk->ring[0].work_done.work);
+		WRITE_ONCE(ring->irq_stamp, (u32)ktime_get_ns() | 1);
+
+		switch (READ_ONCE(ring->done_mode)) {
+		case MTK_DONE_THREAD:
+			return IRQ_WAKE_THREAD;
+		case MTK_DONE_WORK:
+			queue_work(ring->workdone, &ring->work_done.work);
+			break;
+		default:
+			tasklet_schedule(&mtk->tasklet);
+		}
+
 		return IRQ_HANDLED;
 	}
 
-/* TODO: error handler; for now just clear ALL */
-	dev_err(mtk->dev, "IRQ: %08x\n", irq_status);
+	if (!irq_status)
+		return IRQ_NONE;
+
+	/* nothing else is serviced: acknowledge and mask it for good */
+	dev_warn_ratelimited(mtk->dev, "unhandled IRQ %08x, masked\n",
+				irq_status);
 	mtk_irq_clear(mtk, irq_status);
-	if (irq_status) {
-		printk("disable irq\n");
-		mtk_irq_disable(mtk, irq_status);
+	mtk_irq_disable(mtk, irq_status);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * One completion round, the same in every mode: retire results, feed
+ * queued requests, start what was sent and run the callbacks. done_lock
+ * only covers the walk over the results, which must not overlap, also
+ * while the mode is being switched. Everything after it runs with BH on
+ * but for each callback, so the thread and work modes stay preemptible.
+ * Returns true when results are still waiting.
+ */
+static bool mtk_done_run(struct mtk_device *mtk, int mode)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_done_stats *stats = &ring->done_stats[mode];
+	struct cpumask *kick = &ring->done_kick[mode];
+	struct crypto_async_request *req, *tmp;
+	LIST_HEAD(finished);
+	u32 stamp, delay, done;
+	bool more;
+
+	spin_lock_bh(&ring->done_lock);
+
+	stamp = READ_ONCE(ring->irq_stamp);
+	if (stamp) {
+		WRITE_ONCE(ring->irq_stamp, 0);
+		delay = (u32)ktime_get_ns() - stamp;
+		stats->latency_ns += delay;
+		stats->latency_max = max(stats->latency_max, delay);
+		stats->irqs++;
+		ring->coal.irq = true;
+	}
+
+	more = mtk_handle_result_descriptor(mtk,
+			max_t(u32, READ_ONCE(poll_budget), 1), &done, &finished);
+
+	/*
+	 * Only RDR interrupts steer moderation, together with the rounds
+	 * that continue one after the budget ran out; rounds kicked by
+	 * submitters or mode switches would look like tiny batches.
+	 */
+	if (ring->coal.irq) {
+		ring->coal.irq_ndesc += done;
+		if (!more) {
+			mtk_ring_coal_update(mtk, ring->coal.irq_ndesc);
+			ring->coal.irq = false;
+			ring->coal.irq_ndesc = 0;
+		}
 	}
-	return IRQ_NONE;
+	stats->runs++;
+	stats->ndesc += done;
+
+	spin_unlock_bh(&ring->done_lock);
+
+	/* in the order the engine finished them, before what feeding fails */
+	cpumask_clear(kick);
+	list_for_each_entry_safe(req, tmp, &finished, list)
+		mtk_complete(mtk, req, mtk_async_reqctx(req)->err, kick);
+
+	mtk_dequeue(mtk, kick);
+	/* what this round sent goes out as one batch */
+	mtk_ring_flush(mtk);
+	mtk_steer_kick(mtk, kick);
+
+	return more;
+}
+
+/*
+ * Let the RDR interrupt in again after the last round, unless a submitter
+ * spins on a result: its counted but unacknowledged descriptors would
+ * raise it over and over. The submitter kicks a round when it stops.
+ */
+static void mtk_done_unmask(struct mtk_device *mtk)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	u32 state;
+
+	if (test_bit(MTK_RING_POLL, &ring->state)) {
+		state = smp_load_acquire(&ring->poll_state);
+		if (state == MTK_POLL_WAIT || state == MTK_POLL_BUSY)
+			return;
+	}
+
+	mtk_irq_enable(mtk, BIT(1));
 }
 
 static void mtk_done_tasklet(unsigned long data)
 {
 	struct mtk_device *mtk = (struct mtk_device *)data;
 
-	mtk_handle_result_descriptor(mtk);
+	if (mtk_done_run(mtk, MTK_DONE_TASKLET)) {
+		/* budget spent: let other softirqs run, then poll again */
+		tasklet_schedule(&mtk->tasklet);
+		return;
+	}
+
+	mtk_done_unmask(mtk);
+}
+
+/* threaded IRQ and workqueue: may sleep between rounds */
+static void mtk_done_loop(struct mtk_device *mtk, int mode)
+{
+	while (mtk_done_run(mtk, mode))
+		cond_resched();
+
+	mtk_done_unmask(mtk);
+}
+
+static irqreturn_t mtk_irq_thread(int irq, void *dev_id)
+{
+	mtk_done_loop((struct mtk_device *)dev_id, MTK_DONE_THREAD);
+
+	return IRQ_HANDLED;
 }
 
 static void mtk_done_work(struct work_struct *work)
@@ -294,8 +880,86 @@ static void mtk_done_work(struct work_struct *work)
 	struct mtk_work_data *data =
 		container_of(work, struct mtk_work_data, work);
 
-	mtk_handle_result_descriptor(data->mtk);
+	mtk_done_loop(data->mtk, MTK_DONE_WORK);
+}
+
+static const char * const mtk_done_names[MTK_DONE_MODES] = {
+	[MTK_DONE_TASKLET]	= "tasklet",
+	[MTK_DONE_THREAD]	= "thread",
+	[MTK_DONE_WORK]		= "work",
+};
+
+static ssize_t done_mode_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct mtk_device *mtk = dev_get_drvdata(dev);
+	u32 mode = READ_ONCE(mtk->ring[0].done_mode);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < MTK_DONE_MODES; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				i == mode ? "[%s] " : "%s ", mtk_done_names[i]);
+
+	buf[len - 1] = '\n';
+
+	return len;
+}
+
+/* a round still running in the old mode finishes before the next starts */
+static ssize_t done_mode_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct mtk_device *mtk = dev_get_drvdata(dev);
+	int mode;
+
+	mode = sysfs_match_string(mtk_done_names, buf);
+	if (mode < 0)
+		return mode;
+
+	WRITE_ONCE(mtk->ring[0].done_mode, mode);
+	/* pick up anything that was signalled to the old mode */
+	mtk_done_kick(mtk);
+
+	return count;
+}
+static DEVICE_ATTR_RW(done_mode);
+
+static ssize_t done_stats_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct mtk_device *mtk = dev_get_drvdata(dev);
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_done_stats stats[MTK_DONE_MODES];
+	ssize_t len = 0;
+	int i;
+
+	spin_lock_bh(&ring->done_lock);
+	memcpy(stats, ring->done_stats, sizeof(stats));
+	spin_unlock_bh(&ring->done_lock);
+
+	for (i = 0; i < MTK_DONE_MODES; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+			"%-8s runs %llu descs %llu irqs %u latency avg %llu max %u ns\n",
+			mtk_done_names[i], stats[i].runs, stats[i].ndesc,
+			stats[i].irqs, stats[i].irqs ?
+			div_u64(stats[i].latency_ns, stats[i].irqs) : 0,
+			stats[i].latency_max);
+
+	return len;
 }
+static DEVICE_ATTR_RO(done_stats);
+
+static struct attribute *mtk_done_attrs[] = {
+	&dev_attr_done_mode.attr,
+	&dev_attr_done_stats.attr,
+	NULL
+};
+
+static const struct attribute_group mtk_done_group = {
+	.attrs = mtk_done_attrs,
+};
 
 void mtk_initialize(struct mtk_device *mtk)
 {
@@ -309,7 +973,7 @@ void mtk_initialize(struct mtk_device *mtk)
 	uint8_t fEnablePDRUpdate = 1;
 	int InputThreshold = 128;
 	int OutputThreshold = 128;
-	int DescriptorCountDone = MTK_RING_SIZE - 1;
+	int DescriptorCountDone = mtk->ring[0].size - 1;
 	int DescriptorPendingCount = 1;
 	int DescriptorDoneTimeout = 15;
 	u32 regVal;
@@ -379,6 +1043,138 @@ void mtk_initialize(struct mtk_device *mtk)
 
 }
 
+/*
+ * Ring depth: the module parameter wins over the device tree, which wins
+ * over MTK_RING_SIZE. dma_buf and the saState pool scale with it.
+ */
+static u32 mtk_ring_depth(struct mtk_device *mtk)
+{
+	u32 size = MTK_RING_SIZE;
+
+	device_property_read_u32(mtk->dev, "mediatek,ring-size", &size);
+
+	if (ring_size)
+		size = ring_size;
+
+	return clamp_t(u32, size, MTK_RING_MIN_SIZE, EIP93_MAX_PE_RING_SIZE);
+}
+
+/*
+ * Bounce buffer size classes: small requests, IPsec packets up to an
+ * MTU, and larger ones. Allocated and mapped once at probe, in whole
+ * pages: with sizes that are cache line multiples no two buffers share
+ * a line, which streaming DMA on non-coherent systems relies on.
+ */
+static const struct {
+	u32	size;
+	u32	count;
+} mtk_bounce_classes[MTK_BOUNCE_CLASSES] = {
+	{   512, 64 },
+	{  2048, 64 },
+	{ 16384,  8 },
+};
+
+static int mtk_bounce_init(struct mtk_device *mtk)
+{
+	struct mtk_bounce_pool *pool;
+	int i;
+
+	for (i = 0; i < MTK_BOUNCE_CLASSES; i++) {
+		pool = &mtk->bounce[i];
+		pool->size = mtk_bounce_classes[i].size;
+		pool->count = mtk_bounce_classes[i].count;
+
+		pool->map = devm_kcalloc(mtk->dev, BITS_TO_LONGS(pool->count),
+					sizeof(unsigned long), GFP_KERNEL);
+		pool->buf = (void *)__get_free_pages(GFP_KERNEL | GFP_DMA,
+					get_order(pool->size * pool->count));
+		if (!pool->map || !pool->buf)
+			return -ENOMEM;
+
+		pool->base = dma_map_single(mtk->dev, pool->buf,
+					pool->size * pool->count,
+					DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(mtk->dev, pool->base)) {
+			pool->base = 0;
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void mtk_bounce_free(struct mtk_device *mtk)
+{
+	struct mtk_bounce_pool *pool;
+	int i;
+
+	for (i = 0; i < MTK_BOUNCE_CLASSES; i++) {
+		pool = &mtk->bounce[i];
+		if (pool->base)
+			dma_unmap_single(mtk->dev, pool->base,
+				pool->size * pool->count, DMA_BIDIRECTIONAL);
+		pool->base = 0;
+
+		if (pool->buf)
+			free_pages((unsigned long)pool->buf,
+				get_order(pool->size * pool->count));
+		pool->buf = NULL;
+	}
+}
+
+/*
+ * One descriptor ring in coherent memory, or with cached_rings in
+ * cacheable memory that is mapped once and synced by the ring code per
+ * batch of slots. Cached slots are padded to the DMA cache alignment, so
+ * syncing one slot never touches another.
+ */
+static int mtk_desc_ring_alloc(struct mtk_device *mtk,
+				struct mtk_desc_ring *r)
+{
+	u32 ring_size = mtk->ring[0].size;
+
+	if (!mtk->ring[0].cached) {
+		r->offset = sizeof(struct eip93_descriptor_s);
+		r->base = dma_alloc_coherent(mtk->dev, r->offset * ring_size,
+						&r->base_dma, GFP_KERNEL);
+		return r->base ? 0 : -ENOMEM;
+	}
+
+	r->offset = ALIGN(sizeof(struct eip93_descriptor_s),
+				dma_get_cache_alignment());
+	r->base = kzalloc(r->offset * ring_size, GFP_KERNEL | GFP_DMA);
+	if (!r->base)
+		return -ENOMEM;
+
+	r->base_dma = dma_map_single(mtk->dev, r->base, r->offset * ring_size,
+					DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(mtk->dev, r->base_dma)) {
+		kfree(r->base);
+		r->base = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void mtk_desc_ring_free(struct mtk_device *mtk,
+				struct mtk_desc_ring *r)
+{
+	size_t size = r->offset * mtk->ring[0].size;
+
+	if (!r->base)
+		return;
+
+	if (mtk->ring[0].cached) {
+		dma_unmap_single(mtk->dev, r->base_dma, size,
+				DMA_BIDIRECTIONAL);
+		kfree(r->base);
+	} else
+		dma_free_coherent(mtk->dev, size, r->base, r->base_dma);
+
+	r->base = NULL;
+}
+
 static void mtk_desc_free(struct mtk_device *mtk,
 				struct mtk_desc_ring *cdr,
 				struct mtk_desc_ring *rdr)
@@ -389,20 +1185,10 @@ static void mtk_desc_free(struct mtk_device *mtk,
 	writel(0, mtk->base + EIP93_REG_PE_CDR_BASE);
 	writel(0, mtk->base + EIP93_REG_PE_RDR_BASE);
 
-	dma_free_coherent(mtk->dev, cdr->offset, cdr->base, cdr->base_dma);
-
-	dma_free_coherent(mtk->dev, rdr->offset, rdr->base, rdr->base_dma);
-
-	size = MTK_RING_SIZE * sizeof(struct saRecord_s);
+	mtk_desc_ring_free(mtk, cdr);
+	mtk_desc_ring_free(mtk, rdr);
 
-	if (mtk->saRecord) {
-		dma_free_coherent(mtk->dev, size, mtk->saRecord,
-				mtk->saRecord_base);
-		mtk->saRecord = NULL;
-		mtk->saRecord_base = 0;
-	}
-
-	size = MTK_RING_SIZE * sizeof(struct saState_s);
+	size = mtk->state_count * MTK_STATE_STRIDE;
 
 	if (mtk->saState) {
 		dma_free_coherent(mtk->dev, size, mtk->saState,
@@ -410,6 +1196,8 @@ static void mtk_desc_free(struct mtk_device *mtk,
 		mtk->saState = NULL;
 		mtk->saState_base = 0;
 	}
+
+	mtk_bounce_free(mtk);
 }
 
 static int mtk_desc_init(struct mtk_device *mtk,
@@ -417,66 +1205,74 @@ static int mtk_desc_init(struct mtk_device *mtk,
 			struct mtk_desc_ring *rdr)
 {
 	int RingOffset, RingSize;
+	u32 ring_size = mtk->ring[0].size;
 	size_t	size;
 
-	cdr->offset = sizeof(struct eip93_descriptor_s);
-	cdr->base = dma_alloc_coherent(mtk->dev, cdr->offset * MTK_RING_SIZE,
-					&cdr->base_dma, GFP_KERNEL);
-	if (!cdr->base)
+	if (mtk_desc_ring_alloc(mtk, cdr))
 		goto err_cleanup;
-	cdr->write = cdr->base;
-	cdr->base_end = cdr->base + cdr->offset * (MTK_RING_SIZE - 1);
-	cdr->read  = cdr->base;
 
 	dev_dbg(mtk->dev, "CD Ring : %08X\n", cdr->base_dma);
 
-	rdr->offset = sizeof(struct eip93_descriptor_s);
-	rdr->base = dma_alloc_coherent(mtk->dev, rdr->offset * MTK_RING_SIZE,
-					&rdr->base_dma, GFP_KERNEL);
-	if (!rdr->base)
-		goto err_cleanup;
-
-	rdr->write = rdr->base;
-	rdr->base_end = rdr->base + rdr->offset * (MTK_RING_SIZE - 1);
-	rdr->read  = rdr->base;
+	if (mtk_desc_ring_alloc(mtk, rdr))
+		goto free_rings;
 
 	dev_dbg(mtk->dev, "RD Ring : %08X\n", rdr->base_dma);
 
 	writel((u32)cdr->base_dma, mtk->base + EIP93_REG_PE_CDR_BASE);
 	writel((u32)rdr->base_dma, mtk->base + EIP93_REG_PE_RDR_BASE);
 
-	RingOffset = 8; /* 8 words per descriptor */
-	RingSize = MTK_RING_SIZE - 1;
+	RingOffset = cdr->offset / sizeof(u32); /* words per descriptor slot */
+	RingSize = ring_size - 1;
 
 	writel(((RingOffset & GENMASK(8, 0)) << 16) |
 		(RingSize & GENMASK(10, 0)),
 		mtk->base + EIP93_REG_PE_RING_CONFIG);
 
-	size = MTK_RING_SIZE * sizeof(struct saRecord_s);
+	/* Create State records; SA records come from sa_pool per tfm */
+	/* one per ring slot, what the requests in flight can hold */
+	mtk->state_count = ring_size;
+	mtk->state_map = devm_kcalloc(mtk->dev,
+				BITS_TO_LONGS(mtk->state_count),
+				sizeof(unsigned long), GFP_KERNEL);
+	if (!mtk->state_map)
+		goto free_rings;
 
-	/* Create SA and State records */
-	size = (MTK_RING_SIZE * sizeof(struct saRecord_s));
+	size = mtk->state_count * MTK_STATE_STRIDE;
 
-	mtk->saRecord = dma_alloc_coherent(mtk->dev, size,
-				&mtk->saRecord_base, GFP_KERNEL);
+	mtk->saState = dma_alloc_coherent(mtk->dev, size,
+				&mtk->saState_base, GFP_KERNEL);
 
-	if (mtk->saRecord == NULL) {
+	if (mtk->saState == NULL) {
 		dev_err(mtk->dev, "dma_alloc for saState_prepare failed!!\n");
-		goto err_cleanup;
+		goto free_rings;
 	}
 
-	size = (MTK_RING_SIZE * sizeof(struct saState_s));
+	mtk->sa_pool = dmam_pool_create("eip93-sa", mtk->dev,
+				sizeof(struct saRecord_s), L1_CACHE_BYTES, 0);
 
-	mtk->saState = dma_alloc_coherent(mtk->dev, size,
-				&mtk->saState_base, GFP_KERNEL);
+	if (mtk->sa_pool == NULL) {
+		dev_err(mtk->dev, "dma_pool for saRecord failed!!\n");
+		goto free_rings;
+	}
 
-	if (mtk->saState == NULL) {
-		dev_err(mtk->dev, "dma_alloc for saState_prepare failed!!\n");
-		goto free_saRecord;
+	mtk->saNull = dmam_alloc_coherent(mtk->dev, sizeof(struct saRecord_s),
+				&mtk->saNull_base, GFP_KERNEL);
+
+	if (mtk->saNull == NULL) {
+		dev_err(mtk->dev, "dma_alloc for saNull failed!!\n");
+		goto free_rings;
+	}
+	/* NULL cipher, NULL hash, nothing saved to the state record */
+	mtk->saNull->saCmd0.bits.cipher = 15;
+	mtk->saNull->saCmd0.bits.hash = 15;
+
+	if (mtk_bounce_init(mtk)) {
+		dev_err(mtk->dev, "bounce buffer pool failed!!\n");
+		goto free_rings;
 	}
 
 	return 0;
-free_saRecord:
+free_rings:
 	mtk_desc_free(mtk, cdr, rdr);
 err_cleanup:
 	return -ENOMEM;
@@ -508,40 +1304,63 @@ static int mtk_crypto_probe(struct platform_device *pdev)
 		dev_err(mtk->dev, "Cannot get IRQ resource\n");
 		return mtk->irq;
 	}
-	dev_dbg(mtk->dev, "Assigning IRQ: %d", mtk->irq);
-
-	ret = devm_request_irq(mtk->dev, mtk->irq, mtk_irq_handler,
-				IRQF_TRIGGER_HIGH, dev_name(mtk->dev), mtk);
 
 	mtk->ring = devm_kcalloc(mtk->dev, 1, sizeof(*mtk->ring), GFP_KERNEL);
 
 	if (!mtk->ring) {
 		dev_err(mtk->dev, "Can't allocate Ring memory\n");
+		return -ENOMEM;
 	}
 
-	mtk->ring[0].dma_buf = devm_kzalloc(mtk->dev,
-		MTK_RING_SIZE * sizeof(struct mtk_desc_buf), GFP_KERNEL);
+	mtk->ring[0].size = mtk_ring_depth(mtk);
+	mtk->ring[0].cached = cached_rings;
+	mtk->ring[0].busy_watermark = MTK_RING_BUSY(mtk->ring[0].size);
+	dev_dbg(mtk->dev, "Ring size: %d", mtk->ring[0].size);
+
+	mtk->ring[0].dma_buf = devm_kcalloc(mtk->dev, mtk->ring[0].size,
+				sizeof(struct mtk_desc_buf), GFP_KERNEL);
 
 	if (!mtk->ring[0].dma_buf) {
 		dev_err(mtk->dev, "cant allocate dma_buf memory\n");
+		return -ENOMEM;
 	}
 
 	ret = mtk_desc_init(mtk, &mtk->ring[0].cdr, &mtk->ring[0].rdr);
 
-	if (ret == -ENOMEM)
-		return -ENOMEM;
+	if (ret)
+		return ret;
 
-	mtk->ring[0].requests = 0;
-	mtk->ring[0].busy = false;
+	atomic_set(&mtk->ring[0].head, 0);
+	mtk->ring[0].published = 0;
+	mtk->ring[0].tail = 0;
+	mtk->ring[0].state = 0;
+	atomic_set(&mtk->ring[0].requests, 0);
+	mtk_ring_coal_init(mtk);
+	mtk_ring_batch_init(mtk);
 
-	spin_lock_init(&mtk->ring[0].lock);
-	spin_lock_init(&mtk->ring[0].desc_lock);
-	spin_lock_init(&mtk->ring[0].rdesc_lock);
+	atomic_set(&mtk->ring[0].seq, 0);
+	spin_lock_init(&mtk->ring[0].queue_lock);
+	crypto_init_queue(&mtk->ring[0].queue, MTK_QUEUE_LENGTH);
+	INIT_LIST_HEAD(&mtk->ring[0].streams);
 
 
 	mtk->ring[0].work_done.mtk = mtk;
 	INIT_WORK(&mtk->ring[0].work_done.work, mtk_done_work);
-	mtk->ring[0].workdone = create_workqueue("eip93_done");
+	/* bound: a round runs on the CPU that took the interrupt */
+	mtk->ring[0].workdone = alloc_workqueue("eip93_done",
+					WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!mtk->ring[0].workdone) {
+		ret = -ENOMEM;
+		goto err_desc_free;
+	}
+	mtk->ring[0].done_mode = MTK_DONE_TASKLET;
+	spin_lock_init(&mtk->ring[0].done_lock);
+
+	ret = mtk_steer_init(mtk);
+	if (ret) {
+		dev_err(mtk->dev, "Can't allocate steering queues\n");
+		goto err_destroy_wq;
+	}
 
 	/* Init tasklet for bottom half processing */
 	tasklet_init(&mtk->tasklet, mtk_done_tasklet, (unsigned long)mtk);
@@ -549,6 +1368,19 @@ static int mtk_crypto_probe(struct platform_device *pdev)
 	mtk->prng = devm_kcalloc(mtk->dev, 1, sizeof(*mtk->prng), GFP_KERNEL);
 	if (!mtk->prng) {
 		dev_err(mtk->dev, "Can't allocate PRNG memory\n");
+		ret = -ENOMEM;
+		goto err_steer_free;
+	}
+
+	/* everything the handlers use is in place now */
+	dev_dbg(mtk->dev, "Assigning IRQ: %d", mtk->irq);
+
+	ret = devm_request_threaded_irq(mtk->dev, mtk->irq, mtk_irq_handler,
+				mtk_irq_thread, IRQF_TRIGGER_HIGH,
+				dev_name(mtk->dev), mtk);
+	if (ret) {
+		dev_err(mtk->dev, "Cannot request IRQ %d\n", mtk->irq);
+		goto err_steer_free;
 	}
 
 	mtk_initialize(mtk);
@@ -561,11 +1393,24 @@ static int mtk_crypto_probe(struct platform_device *pdev)
 	else
 		dev_err(mtk->dev, "Could not initialize PRNG");
 
+	ret = devm_device_add_group(mtk->dev, &mtk_done_group);
+	if (ret)
+		dev_err(mtk->dev, "Could not add done_mode attributes\n");
+
 	ret = mtk_register_algs(mtk);
 
 	dev_info(mtk->dev, "EIP93 initialized succesfull\n");
 
 	return 0;
+
+err_steer_free:
+	mtk_steer_free(mtk);
+err_destroy_wq:
+	destroy_workqueue(mtk->ring[0].workdone);
+err_desc_free:
+	mtk_desc_free(mtk, &mtk->ring[0].cdr, &mtk->ring[0].rdr);
+
+	return ret;
 }
 
 static int mtk_crypto_remove(struct platform_device *pdev)
@@ -581,7 +1426,9 @@ static int mtk_crypto_remove(struct platform_device *pdev)
 	writel(0, mtk->base + EIP93_REG_PE_CLOCK_CTRL);
 
 	destroy_workqueue(mtk->ring[0].workdone);
+	hrtimer_cancel(&mtk->ring[0].batch.timer);
 	tasklet_kill(&mtk->tasklet);
+	mtk_steer_free(mtk);
 
 	mtk_desc_free(mtk, &mtk->ring[0].cdr, &mtk->ring[0].rdr);
 	dev_info(mtk->dev, "EIP93 removed.\n");
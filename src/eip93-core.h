@@ -9,6 +9,8 @@
 
 #include <linux/atomic.h>
 #include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/irq_work.h>
 #include <crypto/aead.h>
 #include <crypto/internal/hash.h>
 #include <crypto/internal/rng.h>
@@ -19,6 +21,51 @@ struct mtk_work_data {
 	struct mtk_device	*mtk;
 };
 
+/**
+ * struct mtk_bounce_pool - bounce buffers of one size class
+ * @buf: @count buffers of @size bytes, mapped once at probe
+ * @base: bus address of @buf
+ * @map: a set bit marks a buffer in use
+ */
+struct mtk_bounce_pool {
+	void			*buf;
+	dma_addr_t		base;
+	u32			size;
+	u32			count;
+	unsigned long		*map;
+};
+
+/**
+ * struct mtk_bounce - bounce buffer held by one request
+ * @cls: size class in mtk->bounce, -1 for a buffer too large for any
+ * @idx: buffer within the class
+ * @mapped: bus address valid; pool buffers always are
+ */
+struct mtk_bounce {
+	void			*buf;
+	dma_addr_t		dma;
+	u32			len;
+	int			cls;
+	u32			idx;
+	bool			mapped;
+};
+
+/**
+ * struct mtk_steer - completions handed to one CPU, see mtk_complete()
+ * @work: raised on the CPU, schedules @tasklet there
+ * @tasklet: runs the callbacks of @list, see mtk_steer_drain()
+ * @lock: protects @list
+ * @list: requests to complete in order, linked through their list entry
+ * @busy: bit 0 is held by the one context running the callbacks
+ */
+struct mtk_steer {
+	struct irq_work		work;
+	struct tasklet_struct	tasklet;
+	spinlock_t		lock;
+	struct list_head	list;
+	unsigned long		busy;
+};
+
 /**
  * struct mtk_device - crypto engine device structure
  */
@@ -30,11 +77,21 @@ struct mtk_device {
 	struct tasklet_struct	tasklet;
 
 	struct mtk_ring		*ring;
+	/* per CPU completion queues */
+	struct mtk_steer __percpu	*steer;
 
-	struct saRecord_s	*saRecord;
-	struct saState_s	*saState;
+	/* per-tfm SA records */
+	struct dma_pool		*sa_pool;
+	/* state pool, MTK_STATE_STRIDE apart; a set bit marks one in use */
+	void			*saState;
 	dma_addr_t		saState_base;
-	dma_addr_t		saRecord_base;
+	unsigned long		*state_map;
+	u32			state_count;
+	/* pre-mapped bounce buffers for misaligned and AEAD requests */
+	struct mtk_bounce_pool	bounce[MTK_BOUNCE_CLASSES];
+	/* no-op SA used to fill rolled back ring slots */
+	struct saRecord_s	*saNull;
+	dma_addr_t		saNull_base;
 
 	struct mtk_prng_device	*prng;
 };
@@ -54,56 +111,159 @@ struct mtk_prng_device {
  * struct mtk_desc_buf - holds the records associated with the ringbuffer
  * @flags: Flags to indicate e.g. last block.
  * @req: crypto_async_request
- * @saPointer: reference to saState to retreive IV
+ * @saPointer: state pool index of the request's saState to retreive IV
+ * @cookie: userId of the request's descriptors, set on its first slot
  */
 struct mtk_desc_buf {
 	u32		flags;
 	u32		*req;
 	u32		saPointer;
+	u32		cookie;
 };
 
 struct mtk_desc_ring {
 	void			*base;
-	void			*base_end;
 	dma_addr_t		base_dma;
-	/* write and read pointers */
-	void			*read;
-	void			*write;
 	/* descriptor element offset */
 	u32			offset;
 };
 
-struct mtk_ring {
-	spinlock_t			lock;
+/*
+ * Adaptive interrupt moderation, retuned after each served RDR interrupt
+ * from the completion rate and batch size seen over a window of them.
+ * pending/timeout are what mtk_push_request() writes to PE_RING_THRESH.
+ */
+struct mtk_ring_coal {
+	u32			pending;
+	u32			timeout;
+	u32			level;
+	int			step;
+	u32			events;
+	u32			ndesc;
+	u64			stamp;
+	/* descriptors per millisecond over the previous window */
+	u32			rate;
+	/* an RDR interrupt is being served, @irq_ndesc retired so far */
+	bool			irq;
+	u32			irq_ndesc;
+};
 
+/*
+ * Doorbell batching: published descriptors wait for batch_max of them or
+ * for the batch_us deadline on @timer, whichever comes first.
+ * @pending: published descriptors not yet given to the engine
+ */
+struct mtk_ring_batch {
+	struct hrtimer		timer;
+	struct mtk_device	*mtk;
+	atomic_t		pending;
+};
+
+/* completion context, selected through the done_mode attribute */
+#define MTK_DONE_TASKLET		0
+#define MTK_DONE_THREAD			1
+#define MTK_DONE_WORK			2
+#define MTK_DONE_MODES			3
+
+/*
+ * Per completion mode: rounds run, result descriptors retired in them,
+ * and the time from the RDR interrupt to the round that served it.
+ */
+struct mtk_done_stats {
+	u64			runs;
+	u64			ndesc;
+	u64			latency_ns;
+	u32			latency_max;
+	u32			irqs;
+};
+
+/* mtk_ring state bits */
+#define MTK_RING_DOORBELL		0
+#define MTK_RING_ACTIVE			1
+#define MTK_RING_POLL			2
+#define MTK_RING_BATCH			3
+#define MTK_RING_FEED			4
+#define MTK_RING_REFEED			5
+
+/* poll_state: who finishes the polled request */
+#define MTK_POLL_WAIT			0
+#define MTK_POLL_BUSY			1
+#define MTK_POLL_DONE			2
+#define MTK_POLL_ASYNC			3
+
+struct mtk_ring {
 	struct workqueue_struct		*workdone;
 	struct mtk_work_data		work_done;
+	/* MTK_DONE_*; result walks in any mode are serialized by done_lock */
+	u32				done_mode;
+	spinlock_t			done_lock;
+	struct mtk_done_stats		done_stats[MTK_DONE_MODES];
+	/*
+	 * CPUs to kick after a round, per mode: a mode's rounds never
+	 * overlap, those of two modes can while the mode is switched
+	 */
+	struct cpumask			done_kick[MTK_DONE_MODES];
+	/* low bits of ktime_get_ns() at the last RDR interrupt, 0 none */
+	u32				irq_stamp;
 
 	/* command/result rings */
 	struct mtk_desc_ring		cdr;
 	struct mtk_desc_ring		rdr;
 	/* descriptor scatter/gather record */
 	struct mtk_desc_buf		*dma_buf;
-	spinlock_t			desc_lock;
-	spinlock_t			rdesc_lock;
+	/* request sequence number for the userId cookie */
+	atomic_t			seq;
+
+	/*
+	 * Slot indices, shared by cdr, rdr and dma_buf:
+	 * head: first free slot, claimed by producers with cmpxchg
+	 * published: first slot not yet handed to the engine
+	 * tail: oldest slot still owned by the engine
+	 */
+	atomic_t			head;
+	u32				published;
+	u32				tail;
+	/*
+	 * MTK_RING_DOORBELL / _ACTIVE / _POLL / _BATCH (deadline armed),
+	 * _FEED (one context feeds the queue) / _REFEED (feed again)
+	 */
+	unsigned long			state;
+	struct mtk_ring_batch		batch;
 
-	/* Number of request in the engine. */
-	int				requests;
+	/* ring depth in descriptors; above the watermark requests queue */
+	u32				size;
+	/* cdr/rdr in cacheable memory, synced per batch of slots */
+	bool				cached;
+	u32				busy_watermark;
 
-	/* The rings is handling at least one request */
-	bool				busy;
+	/* Number of descriptors in the engine. */
+	atomic_t			requests;
+	struct mtk_ring_coal		coal;
+
+	/* request polled by its submitter, owned under MTK_RING_POLL */
+	struct crypto_async_request	*poll_req;
+	u32				poll_cookie;
+	u32				poll_state;
+
+	/* requests waiting for ring space, fed from the completion rounds */
+	struct crypto_queue		queue;
+	spinlock_t			queue_lock;
+
+	/* streamed requests waiting for ring space, under queue_lock */
+	struct list_head		streams;
 
 	/* Store for current request when not
-	 * enough resources avialable.
+	 * enough resources avialable; owned under MTK_RING_FEED.
 	 */
 	struct crypto_async_request	*req;
 	struct crypto_async_request	*backlog;
 };
 
 struct mtk_context {
+	int (*send_req)(struct crypto_async_request *req);
 	int (*handle_result)(struct mtk_device *mtk,
 				struct crypto_async_request *req,
-				bool *complete,  int *ret);
+				u32 saPointer, int err);
 };
 
 enum mtk_alg_type {
@@ -125,4 +285,7 @@ struct mtk_alg_template {
 	} alg;
 };
 
+int mtk_queue_req(struct mtk_device *mtk, struct crypto_async_request *req,
+			u32 len);
+
 #endif /* _CORE_H_ */
@@ -14,14 +14,10 @@
 static int mtk_prng_push_job(struct mtk_device *mtk, bool reset)
 {
 	struct mtk_prng_device *prng = mtk->prng;
-	struct eip93_descriptor_s *cdesc;
-	struct eip93_descriptor_s *rdesc;
+	struct eip93_descriptor_s desc = {};
 	struct mtk_desc_buf *buf;
 	int cur = prng->cur_buf;
-	int len, mode;
-	int DescriptorCountDone = MTK_RING_SIZE - 1;
-	int DescriptorDoneTimeout = 15;
-	int DescriptorPendingCount = 0;
+	int len, mode, err;
 	u32 wptr = 0;
 
 	if (reset) {
@@ -35,41 +31,24 @@ static int mtk_prng_push_job(struct mtk_device *mtk, bool reset)
 	init_completion(&prng->Filled);
 	atomic_set(&prng->State, BUF_EMPTY);
 
-	spin_lock(&mtk->ring[0].desc_lock);
-	cdesc = mtk_add_cdesc(mtk, &wptr);
-
-	cdesc->peCrtlStat.bits.hostReady = 1;
-	cdesc->peCrtlStat.bits.prngMode = mode;
-	cdesc->peCrtlStat.bits.hashFinal = 0;
-	cdesc->peCrtlStat.bits.padCrtlStat = 0;
-	cdesc->peCrtlStat.bits.peReady = 0;
-	cdesc->srcAddr = 0;
-	cdesc->dstAddr = (u32)prng->PRNGBuffer_dma[cur];
-	cdesc->saAddr = (u32)prng->PRNGSaRecord_dma;
-	cdesc->stateAddr = 0;
-	cdesc->arc4Addr = 0;
-	cdesc->userId = 0;
-	cdesc->peLength.bits.byPass = 0;
-	cdesc->peLength.bits.length = 4080;
-	cdesc->peLength.bits.hostReady = 1;
-
-	rdesc = mtk_add_rdesc(mtk, &wptr);
-//	wptr = mtk_ring_cdr_index(mtk, cdesc);
+	err = mtk_ring_reserve(mtk, 1, &wptr);
+	if (err)
+		return false;
+
+	desc.peCrtlStat.bits.hostReady = 1;
+	desc.peCrtlStat.bits.prngMode = mode;
+	desc.dstAddr = (u32)prng->PRNGBuffer_dma[cur];
+	desc.saAddr = (u32)prng->PRNGSaRecord_dma;
+	desc.userId = mtk_ring_cookie(mtk, wptr, 1);
+	desc.peLength.bits.length = 4080;
+	desc.peLength.bits.hostReady = 1;
+
+	mtk_ring_write_desc(mtk, wptr, &desc);
 	buf = &mtk->ring[0].dma_buf[wptr];
-	buf->flags = MTK_DESC_PRNG | MTK_DESC_LAST | MTK_DESC_FINISH;
-	spin_unlock(&mtk->ring[0].desc_lock);
-	/*   */
-	spin_lock_bh(&mtk->ring[0].lock);
-	mtk->ring[0].requests += 1;
-	mtk->ring[0].busy = true;
-	DescriptorPendingCount = min_t(int, mtk->ring[0].requests, 8);
-	writel(BIT(31) | (DescriptorCountDone & GENMASK(10, 0)) |
-		(((DescriptorPendingCount - 1) & GENMASK(10, 0)) << 16) |
-		((DescriptorDoneTimeout  & GENMASK(4, 0)) << 26),
-		mtk->base + EIP93_REG_PE_RING_THRESH);
-	spin_unlock_bh(&mtk->ring[0].lock);
-
-	writel(1, mtk->base + EIP93_REG_PE_CD_COUNT);
+	buf->flags = MTK_DESC_PRNG;
+
+	mtk_ring_publish(mtk, wptr, 1);
+	mtk_ring_flush(mtk);
 
 	wait_for_completion(&prng->Filled);
 
@@ -178,6 +178,8 @@ typedef enum
 
 
 // BYTE_ORDER_CFG register values
+// Target data covers payload and digest alike; there is no digest-only
+// setting, so SHA tags are put in order by the driver (mtk_aead_put_tag)
 #define EIP93_BYTE_ORDER_PD		EIP93_BO_REVERSE_WORD
 #define EIP93_BYTE_ORDER_SA		EIP93_BO_REVERSE_WORD
 #define EIP93_BYTE_ORDER_DATA		EIP93_BO_REVERSE_WORD
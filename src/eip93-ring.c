@@ -5,136 +5,567 @@
  * Richard van Schagen <vschagen@cs.com>
  */
 
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/cache.h>
+#include <linux/dma-mapping.h>
+#include <linux/gfp.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+
 #include "eip93-common.h"
 #include "eip93-core.h"
+#include "eip93-regs.h"
+#include "eip93-ring.h"
+
+static unsigned int batch_us;
+module_param(batch_us, uint, 0644);
+MODULE_PARM_DESC(batch_us,
+	"Longest wait in us before published descriptors are started, 0 starts them at once (default: 0)");
+
+static unsigned int batch_max = MTK_BATCH_MAX;
+module_param(batch_max, uint, 0644);
+MODULE_PARM_DESC(batch_max,
+	"Descriptors that start a batch before its deadline (default: 16)");
+
+/*
+ * CDR, RDR and dma_buf are used in lockstep: slot N of the command ring
+ * always returns its result in slot N of the result ring, so one index
+ * addresses all three.
+ */
+inline u32 mtk_ring_next_index(struct mtk_device *mtk, u32 idx)
+{
+	if (++idx == mtk->ring[0].size)
+		idx = 0;
 
+	return idx;
+}
 
 inline int mtk_ring_first_cdr_index(struct mtk_device *mtk)
 {
-	struct mtk_desc_ring *cdr  = &mtk->ring[0].cdr;
+	return READ_ONCE(mtk->ring[0].tail);
+}
+
+/*
+ * Cached rings: sync slots [idx, idx + n) of @r for the engine or for
+ * the CPU, as one range or two when it wraps around the end of the ring.
+ * Every slot has its own cache lines, see mtk_desc_init().
+ */
+static void mtk_ring_sync(struct mtk_device *mtk, struct mtk_desc_ring *r,
+				u32 idx, u32 n, bool to_device)
+{
+	u32 size = mtk->ring[0].size;
+	dma_addr_t addr;
+	u32 cnt;
+
+	while (n) {
+		cnt = min(n, size - idx);
+		addr = r->base_dma + idx * r->offset;
+
+		if (to_device)
+			dma_sync_single_for_device(mtk->dev, addr,
+					cnt * r->offset, DMA_BIDIRECTIONAL);
+		else
+			dma_sync_single_for_cpu(mtk->dev, addr,
+					cnt * r->offset, DMA_BIDIRECTIONAL);
+
+		idx = 0;
+		n -= cnt;
+	}
+}
 
-	return (cdr->read - cdr->base) / cdr->offset;
+/* make @n result descriptors from slot @idx on readable from the cache */
+inline void mtk_ring_sync_results(struct mtk_device *mtk, u32 idx, u32 n)
+{
+	if (mtk->ring[0].cached)
+		mtk_ring_sync(mtk, &mtk->ring[0].rdr, idx, n, false);
 }
 
-inline int mtk_ring_curr_wptr_index(struct mtk_device *mtk)
+/*
+ * Claim @n consecutive CDR/RDR/dma_buf slots for one request, or none
+ * at all: -EAGAIN tells the caller to back off. Producers race on the
+ * head index with cmpxchg only; nothing else is shared until the slots
+ * are published or rolled back. One slot is always kept free so a full
+ * ring can be told apart from an empty one.
+ */
+int mtk_ring_reserve(struct mtk_device *mtk, u32 n, u32 *idx)
 {
-	struct mtk_desc_ring *cdr  = &mtk->ring[0].cdr;
+	struct mtk_ring *ring = &mtk->ring[0];
+	u32 head, tail, used, next;
+
+	if (!n || n >= ring->size)
+		return -EINVAL;
+
+	do {
+		head = atomic_read(&ring->head);
+		tail = smp_load_acquire(&ring->tail);
+		used = (head + ring->size - tail) % ring->size;
+
+		if (used + n > ring->size - 1)
+			return -EAGAIN;
+
+		next = (head + n) % ring->size;
+	} while (atomic_cmpxchg(&ring->head, head, next) != head);
+
+	*idx = head;
+
+	return 0;
+}
+
+/*
+ * Give back a reservation that will not be published. When no other
+ * producer claimed slots behind it the head simply moves back. Otherwise
+ * the engine has to step over the slots, so they are published as
+ * zero-length descriptors on the null SA and retired by the result path.
+ */
+void mtk_ring_rollback(struct mtk_device *mtk, u32 idx, u32 n)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct eip93_descriptor_s desc = {};
+	u32 end = (idx + n) % ring->size;
+	u32 i, cookie, wptr = idx;
+
+	if (atomic_cmpxchg(&ring->head, end, idx) == end)
+		return;
 
-	return (cdr->write - cdr->base) / cdr->offset;
+	cookie = mtk_ring_cookie(mtk, idx, n);
+
+	desc.peCrtlStat.bits.hostReady = 1;
+	desc.srcAddr = mtk->saNull_base;
+	desc.dstAddr = mtk->saNull_base;
+	desc.saAddr = mtk->saNull_base;
+	desc.userId = cookie;
+	desc.peLength.bits.hostReady = 1;
+
+	for (i = 0; i < n; i++) {
+		mtk_ring_write_desc(mtk, wptr, &desc);
+		ring->dma_buf[wptr].flags = MTK_DESC_NULL;
+		ring->dma_buf[wptr].req = NULL;
+		wptr = mtk_ring_next_index(mtk, wptr);
+	}
+
+	mtk_ring_publish(mtk, idx, n);
 }
 
-inline int mtk_ring_curr_rptr_index(struct mtk_device *mtk)
+/*
+ * Cookie for the @n descriptors of a request starting at slot @idx; it is
+ * kept on the first slot to be checked against the result descriptors.
+ */
+inline u32 mtk_ring_cookie(struct mtk_device *mtk, u32 idx, u32 n)
 {
-	struct mtk_desc_ring *rdr  = &mtk->ring[0].rdr;
+	struct mtk_ring *ring = &mtk->ring[0];
+	u32 cookie = MTK_COOKIE(idx, n, atomic_inc_return(&ring->seq));
+
+	ring->dma_buf[idx].cookie = cookie;
 
-	return (rdr->read - rdr->base) / rdr->offset;
+	return cookie;
 }
 
-inline int mtk_ring_cdr_index(struct mtk_device *mtk,
-				struct eip93_descriptor_s *cdesc)
+/*
+ * Take a saState record for a request, independent of its ring slots.
+ * -EAGAIN when all are in flight, so the request waits in the queue.
+ */
+int mtk_state_get(struct mtk_device *mtk)
 {
-	struct mtk_desc_ring *cdr = &mtk->ring[0].cdr;
+	unsigned long idx;
+
+	do {
+		idx = find_first_zero_bit(mtk->state_map, mtk->state_count);
+		if (idx >= mtk->state_count)
+			return -EAGAIN;
+	} while (test_and_set_bit_lock(idx, mtk->state_map));
 
-	return ((void *)cdesc - cdr->base) / cdr->offset;
+	return idx;
 }
 
-inline int mtk_ring_rdr_index(struct mtk_device *mtk,
-				struct eip93_descriptor_s *rdesc)
+void mtk_state_put(struct mtk_device *mtk, int idx)
 {
-	struct mtk_desc_ring *rdr = &mtk->ring[0].rdr;
+	clear_bit_unlock(idx, mtk->state_map);
+}
 
-	return ((void *)rdesc - rdr->base) / rdr->offset;
+inline struct saState_s *mtk_state(struct mtk_device *mtk, int idx)
+{
+	return mtk->saState + idx * MTK_STATE_STRIDE;
 }
 
-inline void *mtk_ring_next_wptr(struct mtk_device *mtk,
-					struct mtk_desc_ring *ring, u32 *idx)
+inline dma_addr_t mtk_state_base(struct mtk_device *mtk, int idx)
 {
-	void *ptr = ring->write;
+	return mtk->saState_base + idx * MTK_STATE_STRIDE;
+}
 
-	*idx = (ring->write - ring->base) / ring->offset;
+/*
+ * Take a bounce buffer of at least @len bytes from the smallest size class
+ * that has one free, without locking or sleeping. -EAGAIN when the classes
+ * that fit are used up, so the request waits in the queue for completions
+ * to return some. Only requests larger than every class go to the page
+ * allocator; when that fails with requests in flight the request waits
+ * for them the same way, on an idle ring no completion would retry it.
+ */
+int mtk_bounce_get(struct mtk_device *mtk, u32 len, struct mtk_bounce *b)
+{
+	struct mtk_bounce_pool *pool;
+	unsigned long idx;
+	bool fits = false;
+	int i;
+
+	for (i = 0; i < MTK_BOUNCE_CLASSES; i++) {
+		pool = &mtk->bounce[i];
+		if (len > pool->size)
+			continue;
+
+		fits = true;
+		do {
+			idx = find_first_zero_bit(pool->map, pool->count);
+			if (idx >= pool->count)
+				break;
+		} while (test_and_set_bit_lock(idx, pool->map));
+
+		if (idx >= pool->count)
+			continue;
+
+		b->buf = pool->buf + idx * pool->size;
+		b->dma = pool->base + idx * pool->size;
+		b->len = len;
+		b->cls = i;
+		b->idx = idx;
+		b->mapped = true;
+
+		return 0;
+	}
+
+	if (fits)
+		return -EAGAIN;
+
+	b->buf = (void *)__get_free_pages(GFP_ATOMIC | GFP_DMA,
+						get_order(len));
+	if (!b->buf)
+		return atomic_read(&mtk->ring[0].requests) ? -EAGAIN : -ENOMEM;
+
+	b->len = len;
+	b->cls = -1;
+	b->mapped = false;
+
+	return 0;
+}
 
-	if ((ring->write == ring->read - ring->offset) ||
-		(ring->read == ring->base && ring->write == ring->base_end))
-		return ERR_PTR(-ENOMEM);
+/* Hand a filled bounce buffer to the engine */
+int mtk_bounce_to_device(struct mtk_device *mtk, struct mtk_bounce *b)
+{
+	if (b->mapped) {
+		dma_sync_single_for_device(mtk->dev, b->dma, b->len,
+						DMA_BIDIRECTIONAL);
+		return 0;
+	}
 
-	if (ring->write == ring->base_end)
-		ring->write = ring->base;
-	else
-		ring->write += ring->offset;
+	b->dma = dma_map_single(mtk->dev, b->buf, b->len, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(mtk->dev, b->dma))
+		return -ENOMEM;
+
+	b->mapped = true;
 
-	return ptr;
+	return 0;
 }
 
-inline void *mtk_ring_next_rptr(struct mtk_device *mtk,
-					struct mtk_desc_ring *ring, u32 *idx)
+/* Take back a bounce buffer the engine has written */
+void mtk_bounce_to_cpu(struct mtk_device *mtk, struct mtk_bounce *b)
 {
-	void *ptr = ring->read;
+	dma_sync_single_for_cpu(mtk->dev, b->dma, b->len, DMA_BIDIRECTIONAL);
+}
 
-	if (ring->write == ring->read)
-		return ERR_PTR(-ENOENT);
+void mtk_bounce_put(struct mtk_device *mtk, struct mtk_bounce *b)
+{
+	if (b->cls >= 0) {
+		clear_bit_unlock(b->idx, mtk->bounce[b->cls].map);
+		return;
+	}
 
-	*idx = (ring->read - ring->base) / ring->offset;
+	if (b->mapped)
+		dma_unmap_single(mtk->dev, b->dma, b->len, DMA_BIDIRECTIONAL);
 
-	if (ring->read == ring->base_end)
-		ring->read = ring->base;
-	else
-		ring->read += ring->offset;
+	free_pages((unsigned long)b->buf, get_order(b->len));
+}
 
-	return ptr;
+/*
+ * Hand every consecutive ready slot to the engine with a single
+ * CD_COUNT write. Whoever holds the doorbell bit publishes on behalf of
+ * all producers; a producer that finds the bit taken leaves its slots
+ * for the holder, which re-checks after dropping the bit.
+ */
+static void mtk_ring_doorbell(struct mtk_device *mtk)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_desc_buf *buf;
+	u32 idx, count;
+
+	do {
+		if (test_and_set_bit_lock(MTK_RING_DOORBELL, &ring->state))
+			return;
+
+		idx = ring->published;
+		count = 0;
+
+		buf = &ring->dma_buf[idx];
+		while (READ_ONCE(buf->flags) & MTK_DESC_READY) {
+			WRITE_ONCE(buf->flags, buf->flags & ~MTK_DESC_READY);
+			idx = mtk_ring_next_index(mtk, idx);
+			buf = &ring->dma_buf[idx];
+			count++;
+		}
+
+		if (count) {
+			WRITE_ONCE(ring->published, idx);
+			atomic_add(count, &ring->requests);
+			atomic_sub(count, &ring->batch.pending);
+
+			if (!test_and_set_bit(MTK_RING_ACTIVE, &ring->state))
+				mtk_push_request(mtk,
+					atomic_read(&ring->requests));
+
+			/* Writing new descriptor count starts DMA action */
+			writel(count, mtk->base + EIP93_REG_PE_CD_COUNT);
+		}
+
+		clear_bit_unlock(MTK_RING_DOORBELL, &ring->state);
+		smp_mb__after_atomic();
+	} while (READ_ONCE(ring->dma_buf[ring->published].flags) &
+							MTK_DESC_READY);
 }
 
-inline void mtk_ring_rollback_wptr(struct mtk_device *mtk,
-				 	struct mtk_desc_ring *ring)
+/*
+ * Mark @n slots starting at @idx as filled and ring the doorbell. With
+ * batch_us set the doorbell waits until batch_max descriptors are ready
+ * or the deadline armed by the first of them passes, so back-to-back
+ * requests share one CD_COUNT and PE_RING_THRESH write. Callers that
+ * wait for the result themselves use mtk_ring_flush().
+ */
+void mtk_ring_publish(struct mtk_device *mtk, u32 idx, u32 n)
 {
-	if (ring->write == ring->read)
+	struct mtk_ring *ring = &mtk->ring[0];
+	struct mtk_desc_buf *buf;
+	u32 window = READ_ONCE(batch_us);
+	int pending;
+
+	/* the whole batch, including the cleared result slots, in one go */
+	if (mtk->ring[0].cached) {
+		mtk_ring_sync(mtk, &mtk->ring[0].cdr, idx, n, true);
+		mtk_ring_sync(mtk, &mtk->ring[0].rdr, idx, n, true);
+	}
+
+	/* counted before the slots turn ready, the doorbell subtracts them */
+	pending = atomic_add_return(n, &ring->batch.pending);
+
+	/* descriptors have to reach memory before the slot turns ready */
+	wmb();
+
+	while (n--) {
+		buf = &ring->dma_buf[idx];
+		WRITE_ONCE(buf->flags, buf->flags | MTK_DESC_READY);
+		idx = mtk_ring_next_index(mtk, idx);
+	}
+
+	smp_mb();
+
+	if (!window || pending >= READ_ONCE(batch_max)) {
+		mtk_ring_doorbell(mtk);
 		return;
+	}
 
-	if (ring->write == ring->base)
-		ring->write = ring->base_end - ring->offset;
-	else
-		ring->write -= ring->offset;
+	/* first of a batch: its deadline starts now */
+	if (!test_and_set_bit(MTK_RING_BATCH, &ring->state))
+		hrtimer_start(&ring->batch.timer, us_to_ktime(window),
+				HRTIMER_MODE_REL);
+}
+
+/* start whatever waits for the batch deadline */
+void mtk_ring_flush(struct mtk_device *mtk)
+{
+	if (atomic_read(&mtk->ring[0].batch.pending) > 0)
+		mtk_ring_doorbell(mtk);
+}
+
+static enum hrtimer_restart mtk_ring_batch_expire(struct hrtimer *timer)
+{
+	struct mtk_ring_batch *batch = container_of(timer,
+					struct mtk_ring_batch, timer);
+	struct mtk_device *mtk = batch->mtk;
+
+	/* a producer that still sees the bit set is picked up below */
+	clear_bit(MTK_RING_BATCH, &mtk->ring[0].state);
+	smp_mb__after_atomic();
+	mtk_ring_doorbell(mtk);
+
+	return HRTIMER_NORESTART;
+}
+
+void mtk_ring_batch_init(struct mtk_device *mtk)
+{
+	struct mtk_ring_batch *batch = &mtk->ring[0].batch;
+
+	atomic_set(&batch->pending, 0);
+	batch->mtk = mtk;
+	hrtimer_init(&batch->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	batch->timer.function = mtk_ring_batch_expire;
+}
+
+/* Release @n slots at the read pointer back to the producers */
+inline void mtk_ring_next_rptr(struct mtk_device *mtk, u32 n)
+{
+	struct mtk_ring *ring = &mtk->ring[0];
+
+	smp_store_release(&ring->tail, (ring->tail + n) % ring->size);
 }
 
-inline void *mtk_ring_curr_wptr(struct mtk_device *mtk)
+inline struct eip93_descriptor_s *mtk_ring_rdesc(struct mtk_device *mtk,
+								u32 idx)
 {
-	struct mtk_desc_ring *cdr  = &mtk->ring[0].cdr;
+	struct mtk_desc_ring *rdr = &mtk->ring[0].rdr;
+
+	return rdr->base + idx * rdr->offset;
+}
 
-	return cdr->write;
+/*
+ * Store @desc, assembled in cached memory, to slot @idx of the CDR and
+ * clear the same RDR slot: eight plain word stores each, where bitfield
+ * updates would read back from the ring, which is uncached by default.
+ * With cached_rings the stores stay in the cache until mtk_ring_publish()
+ * syncs the slots.
+ */
+inline void mtk_ring_write_desc(struct mtk_device *mtk, u32 idx,
+				const struct eip93_descriptor_s *desc)
+{
+	struct mtk_desc_ring *cdr = &mtk->ring[0].cdr;
+	u32 *cdesc = cdr->base + idx * cdr->offset;
+	u32 *rdesc = (u32 *)mtk_ring_rdesc(mtk, idx);
+	const u32 *words = (const u32 *)desc;
+	int i;
+
+	for (i = 0; i < sizeof(*desc) / sizeof(u32); i++) {
+		WRITE_ONCE(rdesc[i], 0);
+		WRITE_ONCE(cdesc[i], words[i]);
+	}
 }
 
-inline void *mtk_ring_curr_rptr(struct mtk_device *mtk)
+inline void mtk_push_request(struct mtk_device *mtk, int DescriptorPendingCount)
 {
-	struct mtk_desc_ring *rdr  = &mtk->ring[0].rdr;
+	struct mtk_ring_coal *coal = &mtk->ring[0].coal;
+	int DescriptorCountDone = mtk->ring[0].size - 1;
+	int DescriptorDoneTimeout = READ_ONCE(coal->timeout);
+
+	/* never wait for more descriptors than the engine holds */
+	DescriptorPendingCount = min_t(int, DescriptorPendingCount,
+					READ_ONCE(coal->pending));
+
+	if (!DescriptorPendingCount)
+		return;
 
-	return rdr->read;
+	writel(BIT(31) | (DescriptorCountDone & GENMASK(10, 0)) |
+		(((DescriptorPendingCount - 1) & GENMASK(10, 0)) << 16) |
+		((DescriptorDoneTimeout  & GENMASK(4, 0)) << 26),
+		mtk->base + EIP93_REG_PE_RING_THRESH);
 }
 
-inline struct eip93_descriptor_s *mtk_add_cdesc(struct mtk_device *mtk,
-								u32 *idx)
+/*
+ * The engine ran dry: drop MTK_RING_ACTIVE so the next doorbell programs
+ * PE_RING_THRESH for its batch. A doorbell that counted its descriptors
+ * while the bit was still set skipped that, so look at the count again
+ * once the bit is clear and program the threshold on its behalf.
+ */
+void mtk_ring_idle(struct mtk_device *mtk)
 {
-	struct eip93_descriptor_s *cdesc;
+	struct mtk_ring *ring = &mtk->ring[0];
 
-	cdesc = mtk_ring_next_wptr(mtk, &mtk->ring[0].cdr, idx);
+	clear_bit(MTK_RING_ACTIVE, &ring->state);
+	smp_mb__after_atomic();
 
-	if (IS_ERR(cdesc))
-		return cdesc;
+	if (atomic_read(&ring->requests) &&
+	    !test_and_set_bit(MTK_RING_ACTIVE, &ring->state))
+		mtk_push_request(mtk, atomic_read(&ring->requests));
+}
 
-	memset(cdesc, 0, sizeof(struct eip93_descriptor_s));
+/*
+ * PE_RING_THRESH pending count and done timeout per moderation level:
+ * one interrupt per descriptor at the bottom, large batches at the top.
+ */
+static const struct {
+	u8	pending;
+	u8	timeout;
+} mtk_coal_profiles[] = {
+	{  1,  1 },
+	{  4,  4 },
+	{  8,  8 },
+	{ 16, 12 },
+	{ 32, 15 },
+};
+
+/* result interrupts per moderation decision */
+#define MTK_COAL_WINDOW		64
+
+static void mtk_ring_coal_set(struct mtk_ring_coal *coal, u32 level)
+{
+	coal->level = level;
+	WRITE_ONCE(coal->pending, mtk_coal_profiles[level].pending);
+	WRITE_ONCE(coal->timeout, mtk_coal_profiles[level].timeout);
+}
 
-	return cdesc;
+void mtk_ring_coal_init(struct mtk_device *mtk)
+{
+	struct mtk_ring_coal *coal = &mtk->ring[0].coal;
+
+	memset(coal, 0, sizeof(*coal));
+	mtk_ring_coal_set(coal, 2);
+	coal->stamp = ktime_get_ns();
 }
 
-inline struct eip93_descriptor_s *mtk_add_rdesc(struct mtk_device *mtk,
-								u32 *idx)
+/*
+ * Account @ndesc descriptors retired for one result interrupt, across all
+ * the rounds that served it, and, once a window is complete, move one
+ * level. Like net DIM a step that cost throughput is undone; otherwise
+ * the batch size decides: interrupts that fire on the pending count ask
+ * for bigger batches, interrupts that fire on the timeout with few
+ * descriptors ask for lower latency. Called from the completion rounds
+ * under done_lock.
+ */
+void mtk_ring_coal_update(struct mtk_device *mtk, u32 ndesc)
 {
-	struct eip93_descriptor_s *rdesc;
+	struct mtk_ring_coal *coal = &mtk->ring[0].coal;
+	u32 batch, rate, pending;
+	u64 now, elapsed;
+	int step, level;
 
-	rdesc = mtk_ring_next_wptr(mtk, &mtk->ring[0].rdr, idx);
+	coal->events++;
+	coal->ndesc += ndesc;
 
-	if (IS_ERR(rdesc))
-		return rdesc;
+	if (coal->events < MTK_COAL_WINDOW)
+		return;
+
+	now = ktime_get_ns();
+	elapsed = max_t(u64, now - coal->stamp, 1);
+	rate = div64_u64((u64)coal->ndesc * NSEC_PER_MSEC, elapsed);
+	batch = coal->ndesc / coal->events;
+	pending = mtk_coal_profiles[coal->level].pending;
+
+	if (batch <= 1)
+		/* light load: go straight back to per-descriptor interrupts */
+		step = -coal->level;
+	else if (coal->step && rate < coal->rate - coal->rate / 8)
+		step = -coal->step;
+	else if (batch >= pending)
+		step = 1;
+	else if (batch * 2 < pending)
+		step = -1;
+	else
+		step = 0;
 
-	memset(rdesc, 0, sizeof(struct eip93_descriptor_s));
+	level = clamp_t(int, coal->level + step, 0,
+			ARRAY_SIZE(mtk_coal_profiles) - 1);
+	coal->step = level - coal->level;
+	mtk_ring_coal_set(coal, level);
 
-	return rdesc;
+	coal->rate = rate;
+	coal->events = 0;
+	coal->ndesc = 0;
+	coal->stamp = now;
 }
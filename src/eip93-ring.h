@@ -5,33 +5,53 @@
  * Richard van Schagen <vschagen@cs.com>
  */
 
+inline u32 mtk_ring_next_index(struct mtk_device *mtk, u32 idx);
+
 inline int mtk_ring_first_cdr_index(struct mtk_device *mtk);
 
-inline int mtk_ring_curr_wptr_index(struct mtk_device *mtk);
+int mtk_ring_reserve(struct mtk_device *mtk, u32 n, u32 *idx);
+
+void mtk_ring_rollback(struct mtk_device *mtk, u32 idx, u32 n);
+
+void mtk_ring_publish(struct mtk_device *mtk, u32 idx, u32 n);
+
+void mtk_ring_flush(struct mtk_device *mtk);
+
+void mtk_ring_batch_init(struct mtk_device *mtk);
+
+inline u32 mtk_ring_cookie(struct mtk_device *mtk, u32 idx, u32 n);
+
+int mtk_state_get(struct mtk_device *mtk);
+
+void mtk_state_put(struct mtk_device *mtk, int idx);
+
+inline struct saState_s *mtk_state(struct mtk_device *mtk, int idx);
+
+inline dma_addr_t mtk_state_base(struct mtk_device *mtk, int idx);
+
+int mtk_bounce_get(struct mtk_device *mtk, u32 len, struct mtk_bounce *b);
+
+int mtk_bounce_to_device(struct mtk_device *mtk, struct mtk_bounce *b);
 
-inline int mtk_ring_curr_rptr_index(struct mtk_device *mtk);
+void mtk_bounce_to_cpu(struct mtk_device *mtk, struct mtk_bounce *b);
 
-inline int mtk_ring_cdr_index(struct mtk_device *mtk,
-					struct eip93_descriptor_s *cdesc);
+void mtk_bounce_put(struct mtk_device *mtk, struct mtk_bounce *b);
 
-inline int mtk_ring_rdr_index(struct mtk_device *mtk,
-					struct eip93_descriptor_s *rdesc);
+inline void mtk_ring_sync_results(struct mtk_device *mtk, u32 idx, u32 n);
 
-inline void *mtk_ring_next_wptr(struct mtk_device *mtk,
-					struct mtk_desc_ring *ring, u32 *idx);
+inline void mtk_ring_next_rptr(struct mtk_device *mtk, u32 n);
 
-inline void *mtk_ring_next_rptr(struct mtk_device *mtk,
-					struct mtk_desc_ring *ring, u32 *idx);
+inline struct eip93_descriptor_s *mtk_ring_rdesc(struct mtk_device *mtk,
+								u32 idx);
 
-inline void mtk_ring_rollback_wptr(struct mtk_device *mtk,
-						struct mtk_desc_ring *ring);
+inline void mtk_ring_write_desc(struct mtk_device *mtk, u32 idx,
+				const struct eip93_descriptor_s *desc);
 
-inline void *mtk_ring_curr_wptr(struct mtk_device *mtk);
+inline void mtk_push_request(struct mtk_device *mtk,
+					int DescriptorPendingCount);
 
-inline void *mtk_ring_curr_rptr(struct mtk_device *mtk);
+void mtk_ring_idle(struct mtk_device *mtk);
 
-inline struct eip93_descriptor_s *mtk_add_cdesc(struct mtk_device *mtk,
-								u32 *idx);
+void mtk_ring_coal_init(struct mtk_device *mtk);
 
-inline struct eip93_descriptor_s *mtk_add_rdesc(struct mtk_device *mtk,
-								u32 *idx);
+void mtk_ring_coal_update(struct mtk_device *mtk, u32 ndesc);